@@ -0,0 +1,441 @@
+/*
+ * ga_bench: reproducible micro and end to end benchmarks.
+ *
+ *   ga_bench [parameter file] [results file]
+ *
+ * The parameter file (ga.rcp by default) supplies the fitness function,
+ * limits, sort and mutation settings as usual; the sizes to sweep can be
+ * set there too:
+ *
+ *   string BENCH_POPULATIONS = 1000,10000
+ *   string BENCH_GENES       = 8,64,1000
+ *   string BENCH_THREADS     = 0,4
+ *   int    BENCH_REPS        = 15
+ *   int    BENCH_GENERATIONS = 50
+ *
+ * Every case runs in a process of its own, forked from a clean parent, so
+ * gene counts, static scratch space and thread pools from one case never
+ * leak into the next. Each case re-seeds the generator from SEED.
+ *
+ * Results are appended to the results file (bench.jsonl by default), one
+ * JSON object per line, and echoed in a readable form on stdout. Micro
+ * benchmarks report the median and minimum time per operation over
+ * BENCH_REPS repetitions, end to end runs report generations per second.
+ */
+#include "global.h"
+#include "population.h"
+#include "individual.h"
+#include "genome.h"
+#include "histogram.h"
+#include <fitness.h>
+#include <threadpool.h>
+
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <vector>
+
+/*-- Global statements --*/
+char state[512];
+parameters *params;
+
+static FILE *results;
+static const char *rcfile = "ga.rcp";
+
+typedef struct {
+  int population;
+  int genes;
+  int threads;
+} bench_case;
+
+/*-- Comma separated list of sizes from the parameter file, or the defaults --*/
+static vector<int> sizes( const char *key, const char *defaults ) {
+  const char *text = params->getString(params->handle(key, PARAM_STRING));
+  if ( !text )
+    text = defaults;
+
+  vector<int> list;
+  char *end;
+  for ( const char *p = text; *p; p = end ) {
+    long n = strtol(p, &end, 10);
+    if ( end == p ) {
+      end++;
+      continue;
+    }
+    list.push_back(n);
+  }
+  return list;
+}
+
+static double now( void ) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+static void idle( void * ) { return; }
+
+class bench {
+
+ public:
+  static void configure( const bench_case & );
+  static void record( const char *, const bench_case &, long, vector<double> & );
+
+  static void sort( const bench_case &, bool );
+  static void breed( const bench_case & );
+  static void statistics( const bench_case & );
+  static void pool( const bench_case & );
+  static void binning( const bench_case & );
+  static void generations( const bench_case & );
+
+  static int reps;
+  static int gens;
+};
+
+int bench::reps = 15;
+int bench::gens = 50;
+
+/*-- Set the child up for one case: sizes, limits, kernels, fitness library --*/
+void bench::configure( const bench_case &c ) {
+
+  if ( c.genes != params->NUMBER_OF_GENES ) {
+    double *lo = new double [c.genes];
+    double *hi = new double [c.genes];
+    for ( int i=0; i<c.genes; i++ ) {
+      lo[i] = params->pLO[i % params->NUMBER_OF_GENES];
+      hi[i] = params->pHI[i % params->NUMBER_OF_GENES];
+    }
+    params->pLO = lo;
+    params->pHI = hi;
+    params->NUMBER_OF_GENES = c.genes;
+  }
+
+  params->INITIAL_POPULATION = c.population;
+  params->NUM_THREADS   = c.threads;
+  params->WORKERS       = NULL;
+  params->ASYNC_FITNESS = c.threads > 0;
+  params->VERBOSE       = 0;
+  params->SHOW_PLOT     = false;
+
+  gene_setup();
+  genome::select(params->NUMBER_OF_GENES, params->MUTATE_SIMPLE);
+
+  initstate(params->SEED, (char *)state, 256);
+  srandom(params->SEED);
+
+  initialize_fitness_library();
+  return;
+}
+
+/*-- One JSON line per result, written in one go so cases can't interleave --*/
+void bench::record( const char *name, const bench_case &c, long ops, vector<double> &seconds ) {
+
+  std::sort(seconds.begin(), seconds.end());
+  double median = 1e9*seconds[seconds.size()/2]/ops;
+  double fastest = 1e9*seconds[0]/ops;
+
+  fprintf(results, "{\"bench\":\"%s\",\"population\":%i,\"genes\":%i,\"threads\":%i,"
+	  "\"gene_format\":%i,\"reps\":%i,\"ops\":%li,\"median_ns\":%.2f,\"min_ns\":%.2f}\n",
+	  name, c.population, c.genes, c.threads, GENE_FORMAT, (int)seconds.size(), ops, median, fastest);
+  fflush(results);
+
+  printf("%-14s pop %7i genes %5i threads %2i  %12.2f ns/op (min %.2f)\n",
+	 name, c.population, c.genes, c.threads, median, fastest);
+  return;
+}
+
+/*-- heap_sort or quick_sort on the same shuffled fitness values every repetition --*/
+void bench::sort( const bench_case &c, bool quick ) {
+
+  population *society = new population();
+  int n = society->last->count;
+
+  vector<individual *> base(n+1), array(n+1);
+  vector<float> fitness(n+1);
+  individual *p = society->first;
+  for ( int i=1; i<=n; i++, p = p->next ) {
+    base[i] = p;
+    fitness[i] = randf();
+  }
+
+  vector<double> seconds;
+  for ( int r=0; r<=reps; r++ ) {
+    for ( int i=1; i<=n; i++ )
+      base[i]->fitness = fitness[i];
+    array = base;
+
+    double start = now();
+    if ( quick )
+      society->quick_sort((void **)&array[0]);
+    else
+      society->heap_sort((void **)&array[0]);
+    if ( r )
+      seconds.push_back(now() - start);
+  }
+
+  record(quick ? "quick_sort" : "heap_sort", c, n, seconds);
+  return;
+}
+
+/*-- get_mate, make_baby, DE trials, fitness and the mutation kernels, each over the whole population --*/
+void bench::breed( const bench_case &c ) {
+
+  population *society = new population();
+  int n = society->last->count;
+
+  vector<individual *> array(n);
+  individual *p = society->first;
+  for ( int i=0; i<n; i++, p = p->next )
+    array[i] = p;
+
+  individual *scratch = new individual();
+  genome *bitflip = genome::select(c.genes, false);
+  vector<double> seconds;
+
+  for ( int r=0; r<=reps; r++ ) {
+    double start = now();
+    for ( int i=0; i<n; i++ )
+      array[i]->get_mate(n, &array[0]);
+    if ( r )
+      seconds.push_back(now() - start);
+  }
+  record("get_mate", c, n, seconds);
+
+  seconds.clear();
+  for ( int r=0; r<=reps; r++ ) {
+    double start = now();
+    for ( int i=0; i<n; i++ )
+      bitflip->crossover(array[i]->gene, array[(i+1) % n]->gene, scratch->gene);
+    if ( r )
+      seconds.push_back(now() - start);
+  }
+  record("crossover", c, n, seconds);
+
+  seconds.clear();
+  for ( int r=0; r<=reps; r++ ) {
+    double start = now();
+    for ( int i=0; i<n; i++ )
+      bitflip->differential(array[i]->gene, array[(i+1) % n]->gene, array[(i+1) % n]->gene,
+			    array[(i+2) % n]->gene, array[(i+3) % n]->gene, 0.0f, 0.5f, 0.9f, scratch->gene);
+    if ( r )
+      seconds.push_back(now() - start);
+  }
+  record("differential", c, n, seconds);
+
+  // Breeding alone; what the fitness function costs is timed on its own below
+  params->MUTATE_SIMPLE = false;
+  seconds.clear();
+  for ( int r=0; r<=reps; r++ ) {
+    double start = now();
+    for ( int i=0; i<n; i++ )
+      array[i]->make_baby(array[(i+1) % n], false);
+    if ( r )
+      seconds.push_back(now() - start);
+  }
+  record("make_baby", c, n, seconds);
+
+  seconds.clear();
+  for ( int r=0; r<=reps; r++ ) {
+    double start = now();
+    for ( int i=0; i<n; i++ ) {
+      scratch->copy(array[i]);
+      scratch->testFitness();
+    }
+    if ( r )
+      seconds.push_back(now() - start);
+  }
+  record("fitness", c, n, seconds);
+
+  // Both mutation kernels straight through the engine, on the same copies
+  seconds.clear();
+  for ( int r=0; r<=reps; r++ ) {
+    double start = now();
+    for ( int i=0; i<n; i++ ) {
+      scratch->copy(array[i]);
+      bitflip->mutate(scratch->gene, scratch->mutation_rate);
+    }
+    if ( r )
+      seconds.push_back(now() - start);
+  }
+  record("mutate", c, n, seconds);
+
+  params->MUTATE_SIMPLE = true;
+  genome *simple = genome::select(c.genes, true);     // bitflip is gone after this
+  seconds.clear();
+  for ( int r=0; r<=reps; r++ ) {
+    double start = now();
+    for ( int i=0; i<n; i++ ) {
+      scratch->copy(array[i]);
+      simple->mutate(scratch->gene, scratch->mutation_rate);
+    }
+    if ( r )
+      seconds.push_back(now() - start);
+  }
+  record("mutate_simple", c, n, seconds);
+
+  return;
+}
+
+/*-- Clone check and statistics, the bookkeeping copy() does every generation --*/
+void bench::statistics( const bench_case &c ) {
+
+  population *society = new population();
+  vector<double> seconds;
+
+  for ( int r=0; r<=reps; r++ ) {
+    double start = now();
+    society->check_for_clones();
+    society->get_statistics();
+    if ( r )
+      seconds.push_back(now() - start);
+  }
+
+  record("statistics", c, society->last->count, seconds);
+  return;
+}
+
+/*-- Round trips through the thread pool with a function that does nothing --*/
+void bench::pool( const bench_case &c ) {
+
+  threadpool *tp = new threadpool( idle, c.threads );
+  vector<char> items(c.population);
+  vector<double> seconds;
+
+  for ( int r=0; r<=reps; r++ ) {
+    double start = now();
+    tp->queue_lock();
+    for ( int i=0; i<c.population; i++ )
+      tp->enqueue(&items[i]);
+    tp->queue_unlock();
+    tp->wait_until_empty();
+    if ( r )
+      seconds.push_back(now() - start);
+  }
+
+  record("threadpool", c, c.population, seconds);
+  return;
+}
+
+/*-- The plotting histogram over the whole population, split over the pool's thread count --*/
+void bench::binning( const bench_case &c ) {
+
+  vector<double> fitness(c.population);
+  for ( int i=0; i<c.population; i++ )
+    fitness[i] = randf();
+
+  histogram h( 100, 0.0, 1.0 );
+  vector<double> seconds;
+
+  for ( int r=0; r<=reps; r++ ) {
+    double start = now();
+    h.reset();
+    h.add(&fitness[0], fitness.size(), c.threads > 0 ? c.threads : 1);
+    if ( r )
+      seconds.push_back(now() - start);
+  }
+
+  record("histogram", c, c.population, seconds);
+  return;
+}
+
+/*-- Whole generations of mate(), fitness included --*/
+void bench::generations( const bench_case &c ) {
+
+  population *society = new population();
+
+  double start = now();
+  for ( int g=0; g<gens; g++ )
+    society->mate();
+  double elapsed = now() - start;
+
+  fprintf(results, "{\"bench\":\"generations\",\"population\":%i,\"genes\":%i,\"threads\":%i,"
+	  "\"gene_format\":%i,\"generations\":%i,\"seconds\":%.6f,\"generations_per_sec\":%.3f}\n",
+	  c.population, c.genes, c.threads, GENE_FORMAT, gens, elapsed, gens/elapsed);
+  fflush(results);
+
+  printf("%-14s pop %7i genes %5i threads %2i  %12.3f gen/s\n",
+	 "generations", c.population, c.genes, c.threads, gens/elapsed);
+  return;
+}
+
+/*-- Fork, set up, run one benchmark, exit --*/
+static void run( void (*body)( const bench_case & ), bench_case c ) {
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if ( pid < 0 ) {
+    perror("fork");
+    exit(errno);
+  }
+
+  if ( !pid ) {
+    bench::configure(c);
+    body(c);
+    fflush(stdout);
+    _exit(0);
+  }
+
+  int status;
+  waitpid(pid, &status, 0);
+  if ( !WIFEXITED(status) || WEXITSTATUS(status) )
+    fprintf(stderr, "ga_bench: case pop %i genes %i threads %i failed\n",
+	    c.population, c.genes, c.threads);
+  return;
+}
+
+static void heap( const bench_case &c )  { bench::sort(c, false); }
+static void quick( const bench_case &c ) { bench::sort(c, true); }
+
+int main( int argc, char** argv ) {
+
+  if ( argc > 1 )
+    rcfile = argv[1];
+  const char *output = ( argc > 2 ) ? argv[2] : "bench.jsonl";
+
+  params = new parameters( (char *)rcfile );
+
+  if ( params->has("BENCH_REPS") )
+    bench::reps = params->getInt(params->handle("BENCH_REPS", PARAM_INT));
+  if ( params->has("BENCH_GENERATIONS") )
+    bench::gens = params->getInt(params->handle("BENCH_GENERATIONS", PARAM_INT));
+
+  vector<int> populations = sizes("BENCH_POPULATIONS", "1000,10000");
+  vector<int> genes       = sizes("BENCH_GENES", "8,64,1000");
+  vector<int> threads     = sizes("BENCH_THREADS", "0,4");
+
+  if ( !(results = fopen(output, "a")) ) {
+    perror(output);
+    exit(errno);
+  }
+
+  for ( unsigned int p=0; p<populations.size(); p++ ) {
+    for ( unsigned int g=0; g<genes.size(); g++ ) {
+      bench_case c = { populations[p], genes[g], 0 };
+      if ( !g ) {
+	run(heap, c);
+	run(quick, c);
+	run(bench::statistics, c);
+      }
+      run(bench::breed, c);
+    }
+
+    for ( unsigned int t=0; t<threads.size(); t++ ) {
+      bench_case c = { populations[p], genes[0], threads[t] };
+      run(bench::binning, c);
+      if ( threads[t] )
+	run(bench::pool, c);
+    }
+  }
+
+  for ( unsigned int p=0; p<populations.size(); p++ )
+    for ( unsigned int g=0; g<genes.size(); g++ )
+      for ( unsigned int t=0; t<threads.size(); t++ ) {
+	bench_case c = { populations[p], genes[g], threads[t] };
+	run(bench::generations, c);
+      }
+
+  fclose(results);
+  delete params;
+  return 0;
+}
@@ -0,0 +1,292 @@
+#include "checkpoint.h"
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+extern char state[512];
+
+/*-- FNV-1a, enough to notice a torn or truncated checkpoint --*/
+uint32_t checkpoint_checksum( const char *p, size_t n ) {
+  uint32_t hash = 2166136261u;
+  for ( size_t i=0; i<n; i++ ) {
+    hash ^= (unsigned char)p[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+checkpoint::checkpoint( const char *file ) {
+  this->filename = new char [strlen(file)+1];
+  strcpy(this->filename, file);
+  this->running  = false;
+  this->finished = true;
+  return;
+}
+
+checkpoint::~checkpoint( void ) {
+  this->wait();
+  delete [] this->filename;
+  return;
+}
+
+/*-- Block until the background writer (if any) is done --*/
+void checkpoint::wait( void ) {
+  if ( this->running ) {
+    pthread_join(this->tid, NULL);
+    this->running = false;
+  }
+  return;
+}
+
+/*-- Lay one population out as fitness, generation, rate, flag and gene blocks --*/
+char *checkpoint::pack( population *society, char *p ) {
+
+  uint32_t nGenes = params->NUMBER_OF_GENES;
+  uint32_t count  = society->last->count;
+
+  float   *fitness    = (float *)p;
+  int32_t *generation = (int32_t *)(fitness + count);
+  float   *rate       = (float *)(generation + count);
+  uint32_t *flags     = (uint32_t *)(rate + count);
+  gene_t  *gene       = (gene_t *)(flags + count);
+
+  individual *person = society->first;
+  for ( uint32_t i=0; i<count && person; i++ ) {
+    fitness[i]    = person->fitness;
+    generation[i] = person->generation;
+    rate[i]       = person->mutation_rate;
+    flags[i]      = (person->estimated ? CHECKPOINT_ESTIMATED : 0) | (person->bounded ? CHECKPOINT_BOUNDED : 0);
+    memcpy(&gene[i*nGenes], person->gene, nGenes*sizeof(gene_t));
+    person = person->next;
+  }
+
+  return (char *)(gene + count*nGenes);
+}
+
+/*-- Grow or shrink the list to match, then overwrite it in place --*/
+char *checkpoint::unpack( population *society, char *p, uint32_t count ) {
+
+  uint32_t nGenes = params->NUMBER_OF_GENES;
+
+  float   *fitness    = (float *)p;
+  int32_t *generation = (int32_t *)(fitness + count);
+  float   *rate       = (float *)(generation + count);
+  uint32_t *flags     = (uint32_t *)(rate + count);
+  gene_t  *gene       = (gene_t *)(flags + count);
+
+  individual *person = society->first;
+  for ( uint32_t i=0; i<count; i++ ) {
+    if ( !person )
+      person = society->push( society->first );
+
+    memcpy(person->gene, &gene[i*nGenes], nGenes*sizeof(gene_t));
+    person->fitness    = fitness[i];
+    person->generation = generation[i];
+    person->mutation_rate = rate[i];
+    person->estimated  = flags[i] & CHECKPOINT_ESTIMATED;
+    person->bounded    = flags[i] & CHECKPOINT_BOUNDED;
+    person = person->next;
+  }
+  if ( count < (uint32_t)society->last->count )
+    society->trim(count);
+  society->recount();
+
+  return (char *)(gene + count*nGenes);
+}
+
+/*
+ * Snapshot the population and start writing it out. If the previous
+ * checkpoint is still being written this one is skipped rather than
+ * holding up the generation loop.
+ */
+bool checkpoint::save( population *society ) {
+
+  if ( this->running && !this->finished ) {
+    if ( params->VERBOSE > 1 )
+      fprintf(stderr, "\ncheckpoint: writer busy, skipping generation %i\n", society->generation);
+    return false;
+  }
+  this->wait();
+
+  population *scratch = society->scratch();
+
+  uint32_t nGenes  = params->NUMBER_OF_GENES;
+  uint32_t count   = society->last->count;
+  uint32_t spare   = scratch ? scratch->last->count : 0;
+  size_t   record  = 2*sizeof(float) + sizeof(int32_t) + sizeof(uint32_t) + nGenes*sizeof(gene_t);
+  size_t   bytes   = sizeof(checkpoint_header) + (count + spare)*record + sizeof(uint32_t);
+
+  this->buffer.resize(bytes);
+
+  checkpoint_header *hdr = (checkpoint_header *)&this->buffer[0];
+  memset(hdr, 0, sizeof(checkpoint_header));
+  strncpy(hdr->magic, CHECKPOINT_MAGIC, sizeof(hdr->magic));
+  hdr->version       = CHECKPOINT_VERSION;
+  hdr->nGenes        = nGenes;
+  hdr->count         = count;
+  hdr->scratch_count = spare;
+  hdr->generation    = society->generation;
+  hdr->mutation_rate = society->mutation_rate;
+  hdr->fitness_version = params->FITNESS_VERSION;
+  hdr->gene_format   = GENE_FORMAT;
+  hdr->seed          = params->SEED;
+
+  /* setstate() on the active state makes glibc write the current
+   * position into the state buffer, so the copy is self contained */
+  setstate(state);
+  memcpy(hdr->rng_state, state, sizeof(hdr->rng_state));
+
+  char *p = pack(society, (char *)(hdr + 1));
+  if ( scratch )
+    pack(scratch, p);
+
+  uint32_t checksum = checkpoint_checksum(&this->buffer[0], bytes - sizeof(uint32_t));
+  memcpy(&this->buffer[bytes - sizeof(uint32_t)], &checksum, sizeof(uint32_t));
+
+  this->finished = false;
+  if ( pthread_create(&this->tid, NULL, checkpoint::writer, this) ) {
+    perror("checkpoint: pthread_create");
+    this->finished = true;
+    return this->write_file();
+  }
+  this->running = true;
+
+  return true;
+}
+
+void *checkpoint::writer( void *arg ) {
+  checkpoint *self = (checkpoint *)arg;
+  self->write_file();
+  self->finished = true;
+  return NULL;
+}
+
+/*-- temp file, fsync, rename, fsync the directory --*/
+bool checkpoint::write_file( void ) {
+
+  char tmpname[strlen(this->filename) + 8];
+  sprintf(tmpname, "%s.tmp", this->filename);
+
+  int fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if ( fd < 0 ) {
+    perror(tmpname);
+    return false;
+  }
+
+  const char *p = &this->buffer[0];
+  size_t n = this->buffer.size();
+  while ( n ) {
+    ssize_t bytes = write(fd, p, n);
+    if ( bytes < 0 && errno == EINTR )
+      continue;
+    if ( bytes <= 0 ) {
+      perror(tmpname);
+      close(fd);
+      unlink(tmpname);
+      return false;
+    }
+    p += bytes;
+    n -= bytes;
+  }
+
+  if ( fsync(fd) || close(fd) ) {
+    perror(tmpname);
+    unlink(tmpname);
+    return false;
+  }
+
+  if ( rename(tmpname, this->filename) ) {
+    perror(this->filename);
+    unlink(tmpname);
+    return false;
+  }
+
+  char dirname_buffer[strlen(this->filename) + 1];
+  strcpy(dirname_buffer, this->filename);
+  int dir = open(dirname(dirname_buffer), O_RDONLY);
+  if ( dir >= 0 ) {
+    fsync(dir);
+    close(dir);
+  }
+
+  return true;
+}
+
+/*-- Replace the population, generation counter, mutation rate and RNG state --*/
+bool checkpoint::load( population *society ) {
+
+  FILE *pFile = fopen(this->filename, "r");
+  if ( !pFile )
+    return false;
+
+  fseek(pFile, 0, SEEK_END);
+  long bytes = ftell(pFile);
+  rewind(pFile);
+
+  if ( bytes < (long)(sizeof(checkpoint_header) + sizeof(uint32_t)) ) {
+    fprintf(stderr, "%s: truncated checkpoint\n", this->filename);
+    fclose(pFile);
+    return false;
+  }
+
+  this->buffer.resize(bytes);
+  size_t got = fread(&this->buffer[0], 1, bytes, pFile);
+  fclose(pFile);
+
+  checkpoint_header *hdr = (checkpoint_header *)&this->buffer[0];
+  uint32_t checksum;
+  memcpy(&checksum, &this->buffer[bytes - sizeof(uint32_t)], sizeof(uint32_t));
+
+  if ( got != (size_t)bytes || strncmp(hdr->magic, CHECKPOINT_MAGIC, sizeof(hdr->magic)) ||
+       hdr->version != CHECKPOINT_VERSION ||
+       checksum != checkpoint_checksum(&this->buffer[0], bytes - sizeof(uint32_t)) ) {
+    fprintf(stderr, "%s: not a valid checkpoint\n", this->filename);
+    return false;
+  }
+
+  if ( (hdr->gene_format ? hdr->gene_format : GENE_FORMAT_LEGACY) != GENE_FORMAT ) {
+    fprintf(stderr, "%s: checkpoint genes are format %#x, this build uses %#x\n",
+	    this->filename, hdr->gene_format, GENE_FORMAT);
+    return false;
+  }
+
+  if ( (int)hdr->nGenes != params->NUMBER_OF_GENES ) {
+    fprintf(stderr, "%s: checkpoint has %i genes, expected %i\n",
+	    this->filename, hdr->nGenes, params->NUMBER_OF_GENES);
+    return false;
+  }
+
+  size_t record = 2*sizeof(float) + sizeof(int32_t) + sizeof(uint32_t) + hdr->nGenes*sizeof(gene_t);
+  if ( (size_t)bytes != sizeof(checkpoint_header) + (hdr->count + hdr->scratch_count)*record + sizeof(uint32_t) ) {
+    fprintf(stderr, "%s: checkpoint size doesn't match its header\n", this->filename);
+    return false;
+  }
+
+  char *p = unpack(society, (char *)(hdr + 1), hdr->count);
+  if ( hdr->scratch_count )
+    unpack(society->scratch(true), p, hdr->scratch_count);
+
+  society->generation = hdr->generation;
+  society->count = society->last->count;
+  society->get_fittest();
+  society->check_for_clones();
+  society->get_statistics();
+
+  /* setstate() saves the current position into the state it's leaving,
+   * so park the generator on a throwaway state first or it would clobber
+   * the position we just restored */
+  char parked[sizeof(hdr->rng_state)];
+  initstate(1, parked, sizeof(parked));
+  memcpy(state, hdr->rng_state, sizeof(hdr->rng_state));
+  setstate(state);
+
+  this->buffer.clear();
+
+  if ( params->VERBOSE )
+    fprintf(stderr, "Resuming from %s at generation %i\n", this->filename, society->generation);
+
+  return true;
+}
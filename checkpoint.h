@@ -0,0 +1,85 @@
+#ifndef __CHECKPOINT_H
+#define __CHECKPOINT_H
+
+#include "global.h"
+#include "population.h"
+
+#include <stdint.h>
+#include <pthread.h>
+#include <vector>
+#include <atomic>
+
+using namespace std;
+
+#define CHECKPOINT_MAGIC    "GACKPT"
+#define CHECKPOINT_VERSION  5
+
+/*-- Per individual flags, since version 4 --*/
+#define CHECKPOINT_ESTIMATED  0x1   // fitness is a surrogate prediction
+#define CHECKPOINT_BOUNDED    0x2   // fitness is only a lower bound (since version 5)
+
+/*
+ * On disk layout, host byte order:
+ *
+ *   checkpoint_header
+ *   float    fitness[count]
+ *   int32_t  generation[count]      (elite generation counters)
+ *   float    mutation_rate[count]   (each individual's own, since version 3)
+ *   uint32_t flags[count]           (CHECKPOINT_* below, since version 4)
+ *   gene_t   gene[count][nGenes]
+ *   ... the same blocks for the scratch population, scratch_count long
+ *   uint32_t checksum               (FNV-1a of everything above)
+ *
+ * The scratch population mate() breeds into is saved as well, since a
+ * few of its slots carry over from one generation to the next and a
+ * restart would otherwise not follow the same path.
+ */
+typedef struct {
+  char     magic[8];
+  uint32_t version;
+  uint32_t nGenes;
+  uint32_t count;
+  uint32_t generation;
+  float    mutation_rate;           // the population's average
+  uint32_t scratch_count;
+  uint32_t fitness_version;
+  uint32_t gene_format;             // GENE_FORMAT, 0 from older builds means float
+  uint64_t seed;
+  char     rng_state[256];
+} checkpoint_header;
+
+/*
+ * Periodic, crash consistent snapshots of a running evolution. save()
+ * copies the population into a private buffer and hands it to a background
+ * thread that writes filename.tmp, fsyncs it and renames it over filename,
+ * so there is always one complete checkpoint on disk.
+ */
+class checkpoint {
+
+ public:
+  checkpoint( const char * );
+  ~checkpoint( void );
+
+  bool save( population * );
+  bool load( population * );
+  void wait( void );
+
+ protected:
+
+ private:
+  static void *writer( void * );
+  static char *pack( population *, char * );
+  static char *unpack( population *, char *, uint32_t );
+  bool write_file( void );
+
+  char *filename;
+  vector<char> buffer;
+
+  pthread_t tid;
+  bool running;
+  atomic<bool> finished;
+};
+
+uint32_t checkpoint_checksum( const char *, size_t );
+
+#endif
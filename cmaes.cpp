@@ -0,0 +1,460 @@
+#include "cmaes.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+/*-- Orders sample numbers by their individual's fitness, a lower bound after every exact one --*/
+struct by_fitness {
+  const vector<individual *> &batch;
+  by_fitness( const vector<individual *> &b ) : batch(b) {}
+  bool operator() ( int a, int b ) const {
+    if ( batch[a]->bounded != batch[b]->bounded )
+      return batch[b]->bounded;
+    return batch[a]->fitness < batch[b]->fitness;
+  }
+};
+
+/*-- Householder reduction of symmetric V to tridiagonal d, e (tred2, after JAMA) --*/
+static void tridiagonalize( int n, double *V, double *d, double *e ) {
+
+  for ( int j=0; j<n; j++ )
+    d[j] = V[(n-1)*n + j];
+
+  for ( int i=n-1; i>0; i-- ) {
+
+    double scale = 0.0, h = 0.0;
+    for ( int k=0; k<i; k++ )
+      scale += fabs(d[k]);
+
+    if ( scale == 0.0 ) {
+      e[i] = d[i-1];
+      for ( int j=0; j<i; j++ ) {
+	d[j] = V[(i-1)*n + j];
+	V[i*n + j] = 0.0;
+	V[j*n + i] = 0.0;
+      }
+    } else {
+      for ( int k=0; k<i; k++ ) {
+	d[k] /= scale;
+	h += d[k]*d[k];
+      }
+      double f = d[i-1];
+      double g = sqrt(h);
+      if ( f > 0 )
+	g = -g;
+      e[i] = scale*g;
+      h -= f*g;
+      d[i-1] = f - g;
+      for ( int j=0; j<i; j++ )
+	e[j] = 0.0;
+
+      for ( int j=0; j<i; j++ ) {
+	f = d[j];
+	V[j*n + i] = f;
+	g = e[j] + V[j*n + j]*f;
+	for ( int k=j+1; k<=i-1; k++ ) {
+	  g += V[k*n + j]*d[k];
+	  e[k] += V[k*n + j]*f;
+	}
+	e[j] = g;
+      }
+
+      f = 0.0;
+      for ( int j=0; j<i; j++ ) {
+	e[j] /= h;
+	f += e[j]*d[j];
+      }
+      double hh = f/(h + h);
+      for ( int j=0; j<i; j++ )
+	e[j] -= hh*d[j];
+
+      for ( int j=0; j<i; j++ ) {
+	f = d[j];
+	g = e[j];
+	for ( int k=j; k<=i-1; k++ )
+	  V[k*n + j] -= f*e[k] + g*d[k];
+	d[j] = V[(i-1)*n + j];
+	V[i*n + j] = 0.0;
+      }
+    }
+    d[i] = h;
+  }
+
+  // Accumulate the transformations
+  for ( int i=0; i<n-1; i++ ) {
+    V[(n-1)*n + i] = V[i*n + i];
+    V[i*n + i] = 1.0;
+    double h = d[i+1];
+    if ( h != 0.0 ) {
+      for ( int k=0; k<=i; k++ )
+	d[k] = V[k*n + i+1]/h;
+      for ( int j=0; j<=i; j++ ) {
+	double g = 0.0;
+	for ( int k=0; k<=i; k++ )
+	  g += V[k*n + i+1]*V[k*n + j];
+	for ( int k=0; k<=i; k++ )
+	  V[k*n + j] -= g*d[k];
+      }
+    }
+    for ( int k=0; k<=i; k++ )
+      V[k*n + i+1] = 0.0;
+  }
+  for ( int j=0; j<n; j++ ) {
+    d[j] = V[(n-1)*n + j];
+    V[(n-1)*n + j] = 0.0;
+  }
+  V[(n-1)*n + n-1] = 1.0;
+  e[0] = 0.0;
+
+  return;
+}
+
+/*-- Implicit QL on the tridiagonal form: eigenvalues in d, eigenvectors in V's columns (tql2) --*/
+static void diagonalize( int n, double *V, double *d, double *e ) {
+
+  for ( int i=1; i<n; i++ )
+    e[i-1] = e[i];
+  e[n-1] = 0.0;
+
+  double f = 0.0, tst1 = 0.0;
+  const double eps = pow(2.0, -52.0);
+
+  for ( int l=0; l<n; l++ ) {
+
+    tst1 = max(tst1, fabs(d[l]) + fabs(e[l]));
+    int m = l;
+    while ( m < n-1 && fabs(e[m]) > eps*tst1 )
+      m++;
+
+    if ( m > l ) {
+      do {
+	double g = d[l];
+	double p = (d[l+1] - g)/(2.0*e[l]);
+	double r = hypot(p, 1.0);
+	if ( p < 0 )
+	  r = -r;
+	d[l] = e[l]/(p + r);
+	d[l+1] = e[l]*(p + r);
+	double dl1 = d[l+1];
+	double h = g - d[l];
+	for ( int i=l+2; i<n; i++ )
+	  d[i] -= h;
+	f += h;
+
+	p = d[m];
+	double c = 1.0, c2 = c, c3 = c;
+	double el1 = e[l+1];
+	double s = 0.0, s2 = 0.0;
+	for ( int i=m-1; i>=l; i-- ) {
+	  c3 = c2;
+	  c2 = c;
+	  s2 = s;
+	  g = c*e[i];
+	  h = c*p;
+	  r = hypot(p, e[i]);
+	  e[i+1] = s*r;
+	  s = e[i]/r;
+	  c = p/r;
+	  p = c*d[i] - s*g;
+	  d[i+1] = h + s*(c*g + s*d[i]);
+	  for ( int k=0; k<n; k++ ) {
+	    h = V[k*n + i+1];
+	    V[k*n + i+1] = s*V[k*n + i] + c*h;
+	    V[k*n + i] = c*V[k*n + i] - s*h;
+	  }
+	}
+	p = -s*s2*c3*el1*e[l]/dl1;
+	e[l] = s*p;
+	d[l] = c*p;
+      } while ( fabs(e[l]) > eps*tst1 );
+    }
+    d[l] += f;
+    e[l] = 0.0;
+  }
+
+  return;
+}
+
+cmaes::cmaes( population *society ) {
+
+  this->society = society;
+  this->n = params->NUMBER_OF_GENES;
+  this->lambda = society->last->count;
+  this->mu = this->lambda/2 > 0 ? this->lambda/2 : 1;
+
+  // Hansen's defaults throughout
+  double sum = 0.0, squares = 0.0;
+  for ( int i=0; i<this->mu; i++ ) {
+    this->weights.push_back(log(this->mu + 0.5) - log(i + 1.0));
+    sum += this->weights[i];
+  }
+  for ( int i=0; i<this->mu; i++ ) {
+    this->weights[i] /= sum;
+    squares += this->weights[i]*this->weights[i];
+  }
+  this->mueff = 1.0/squares;
+
+  double N = this->n;
+  this->cc = (4.0 + this->mueff/N)/(N + 4.0 + 2.0*this->mueff/N);
+  this->cs = (this->mueff + 2.0)/(N + this->mueff + 5.0);
+  this->c1 = 2.0/((N + 1.3)*(N + 1.3) + this->mueff);
+  this->cmu = min(1.0 - this->c1, 2.0*(this->mueff - 2.0 + 1.0/this->mueff)/((N + 2.0)*(N + 2.0) + this->mueff));
+  this->damps = 1.0 + 2.0*max(0.0, sqrt((this->mueff - 1.0)/(N + 1.0)) - 1.0) + this->cs;
+  this->chiN = sqrt(N)*(1.0 - 1.0/(4.0*N) + 1.0/(21.0*N*N));
+  this->eigen_interval = max(1, (int)(1.0/((this->c1 + this->cmu)*N*10.0)));
+
+  this->sigma = params->has("CMAES_SIGMA") ? params->getDouble("CMAES_SIGMA") : 0.3;
+  this->ps.assign(this->n, 0.0);
+  this->pc.assign(this->n, 0.0);
+  this->C.assign(this->n*this->n, 0.0);
+  this->B.assign(this->n*this->n, 0.0);
+  this->D.assign(this->n, 1.0);
+  for ( int i=0; i<this->n; i++ )
+    this->C[i*this->n + i] = this->B[i*this->n + i] = 1.0;
+  this->generations = 0;
+  this->decomposed = 0;
+
+  this->steps.assign(this->lambda*this->n, 0.0);
+  this->selected.assign(this->mu*this->n, 0.0);
+  this->rank.resize(this->lambda);
+
+  // Start from the weighted mean of the best half of the (sorted) population
+  this->mean.assign(this->n, 0.0);
+  individual *person = society->first;
+  for ( int k=0; k<this->mu && person; k++, person = person->next ) {
+    for ( int i=0; i<this->n; i++ ) {
+      double span = params->pHI[i] - params->pLO[i];
+      double x = span > 0.0 ? (gene_value(person->gene[i]) - params->pLO[i])/span : 0.5;
+      this->mean[i] += this->weights[k]*x;
+    }
+    this->batch.push_back(person);
+  }
+  for ( ; person; person = person->next )
+    this->batch.push_back(person);
+
+  this->champion = new individual();
+  this->champion->copy(society->first);
+  this->keep_score();
+
+  return;
+}
+
+cmaes::~cmaes( void ) {
+  delete this->champion;
+  return;
+}
+
+/*-- Sample k: x = mean + sigma*B*D*z, clamped to [0,1], written into person's genes --*/
+void cmaes::sample( int k, individual *person ) {
+
+  const int n = this->n;
+  double z[n], y[n];
+
+  for ( int i=0; i<n; i++ )
+    z[i] = this->D[i]*randn();
+
+  for ( int i=0; i<n; i++ ) {
+    const double *row = &this->B[i*n];
+    double sum = 0.0;
+    for ( int j=0; j<n; j++ )
+      sum += row[j]*z[j];
+    y[i] = sum;
+  }
+
+  double *step = &this->steps[k*n];
+  for ( int i=0; i<n; i++ ) {
+    double x = this->mean[i] + this->sigma*y[i];
+    if ( x < 0.0 )
+      x = 0.0;
+    else if ( x > 1.0 )
+      x = 1.0;
+    step[i] = (x - this->mean[i])/this->sigma;
+    person->gene[i] = gene_store(params->pLO[i] + x*(params->pHI[i] - params->pLO[i]));
+  }
+
+  // Every sample is ranked, so none of them can stop early
+  person->generation = 0;
+  person->cutoff = INFINITY;
+  return;
+}
+
+void cmaes::step( void ) {
+
+  uint64_t span = trace_begin();
+
+  // The population is the list of samples; it's re-sorted every generation
+  individual *person = this->society->first;
+  for ( int k=0; k<this->lambda && person; k++, person = person->next ) {
+    this->batch[k] = person;
+    this->sample(k, person);
+  }
+  span = trace_mark("sampling", span);
+
+  optimizer::evaluate(this->batch);
+  span = trace_mark("evaluation", span);
+
+  this->update();
+  trace_end("update", span);
+
+  this->society->sort();
+  this->society->generation++;
+  this->keep_score();
+
+  return;
+}
+
+/*-- Mean, evolution paths, covariance and step size from the lambda evaluated samples --*/
+void cmaes::update( void ) {
+
+  const int n = this->n;
+
+  for ( int k=0; k<this->lambda; k++ )
+    this->rank[k] = k;
+  std::sort(this->rank.begin(), this->rank.end(), by_fitness(this->batch));
+
+  // New mean, and the weighted step that got us there
+  this->previous = this->mean;
+  vector<double> move(n, 0.0);
+  for ( int k=0; k<this->mu; k++ ) {
+    const double *step = &this->steps[this->rank[k]*n];
+    double *keep = &this->selected[k*n];
+    for ( int i=0; i<n; i++ ) {
+      move[i] += this->weights[k]*step[i];
+      keep[i] = step[i];
+    }
+  }
+  for ( int i=0; i<n; i++ )
+    this->mean[i] = this->previous[i] + this->sigma*move[i];
+
+  // C^-1/2 move = B D^-1 B^T move
+  vector<double> t(n, 0.0), whitened(n, 0.0);
+  for ( int j=0; j<n; j++ ) {
+    double sum = 0.0;
+    for ( int i=0; i<n; i++ )
+      sum += this->B[i*n + j]*move[i];
+    t[j] = sum/this->D[j];
+  }
+  for ( int i=0; i<n; i++ ) {
+    double sum = 0.0;
+    for ( int j=0; j<n; j++ )
+      sum += this->B[i*n + j]*t[j];
+    whitened[i] = sum;
+  }
+
+  this->generations++;
+  double a = sqrt(this->cs*(2.0 - this->cs)*this->mueff);
+  double norm = 0.0;
+  for ( int i=0; i<n; i++ ) {
+    this->ps[i] = (1.0 - this->cs)*this->ps[i] + a*whitened[i];
+    norm += this->ps[i]*this->ps[i];
+  }
+  norm = sqrt(norm);
+
+  bool hsig = norm/sqrt(1.0 - pow(1.0 - this->cs, 2.0*this->generations))/this->chiN < 1.4 + 2.0/(n + 1.0);
+  double b = sqrt(this->cc*(2.0 - this->cc)*this->mueff);
+  for ( int i=0; i<n; i++ )
+    this->pc[i] = (1.0 - this->cc)*this->pc[i] + (hsig ? b*move[i] : 0.0);
+
+  double decay = 1.0 - this->c1 - this->cmu;
+  if ( !hsig )
+    decay += this->c1*this->cc*(2.0 - this->cc);
+  this->covariance(decay);
+
+  this->sigma *= exp((this->cs/this->damps)*(norm/this->chiN - 1.0));
+
+  if ( this->generations - this->decomposed >= (unsigned int)this->eigen_interval ) {
+    uint64_t span = trace_begin();
+    this->decompose();
+    trace_end("eigen", span);
+  }
+
+  return;
+}
+
+/*
+ * C = decay*C + c1*pc*pc' + cmu*sum(w_k*y_k*y_k'), the upper triangle a
+ * CMAES_BLOCK square tile at a time so each tile stays in cache while
+ * all mu steps go through it, then mirrored into the lower triangle.
+ */
+void cmaes::covariance( double decay ) {
+
+  const int n = this->n;
+  double *C = &this->C[0];
+  const double *pc = &this->pc[0];
+
+  for ( int ib=0; ib<n; ib+=CMAES_BLOCK ) {
+    int iend = min(ib + CMAES_BLOCK, n);
+    for ( int jb=ib; jb<n; jb+=CMAES_BLOCK ) {
+      int jend = min(jb + CMAES_BLOCK, n);
+
+      for ( int i=ib; i<iend; i++ ) {
+	int j0 = max(jb, i);
+	double r = this->c1*pc[i];
+	for ( int j=j0; j<jend; j++ )
+	  C[i*n + j] = decay*C[i*n + j] + r*pc[j];
+      }
+
+      for ( int k=0; k<this->mu; k++ ) {
+	const double *y = &this->selected[k*n];
+	double w = this->cmu*this->weights[k];
+	for ( int i=ib; i<iend; i++ ) {
+	  int j0 = max(jb, i);
+	  double r = w*y[i];
+	  for ( int j=j0; j<jend; j++ )
+	    C[i*n + j] += r*y[j];
+	}
+      }
+    }
+  }
+
+  for ( int i=0; i<n; i++ )
+    for ( int j=0; j<i; j++ )
+      C[i*n + j] = C[j*n + i];
+
+  return;
+}
+
+/*-- B and D from C; eigenvalues that rounding pushed below zero are floored --*/
+void cmaes::decompose( void ) {
+
+  const int n = this->n;
+  vector<double> e(n, 0.0);
+
+  this->B = this->C;
+  tridiagonalize(n, &this->B[0], &this->D[0], &e[0]);
+  diagonalize(n, &this->B[0], &this->D[0], &e[0]);
+
+  for ( int i=0; i<n; i++ )
+    this->D[i] = sqrt(max(this->D[i], 1e-20));
+
+  this->decomposed = this->generations;
+  return;
+}
+
+/*-- Population statistics, and the best individual seen yet as mostfit --*/
+void cmaes::keep_score( void ) {
+
+  if ( this->society->first->fitness < this->champion->fitness )
+    this->champion->copy(this->society->first);
+
+  this->society->count = this->society->last->count;
+  this->society->check_for_clones();
+  this->society->get_statistics();
+  this->society->mutation_rate = this->sigma;
+  this->society->mostfit = this->champion;
+
+  return;
+}
+
+/*-- Put the best individual found back in the population, in place of the worst --*/
+void cmaes::finish( void ) {
+
+  if ( this->champion->fitness < this->society->first->fitness ) {
+    this->society->last->copy(this->champion);
+    this->society->sort();
+  }
+  this->society->mostfit = this->society->first;
+
+  return;
+}
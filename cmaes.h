@@ -0,0 +1,80 @@
+#ifndef __CMAES_H
+#define __CMAES_H
+
+#include "optimizer.h"
+
+#include <vector>
+
+using namespace std;
+
+#define CMAES_BLOCK  64             // covariance tile edge, in doubles
+
+/*
+ * CMA-ES (Hansen's (mu/mu_w, lambda) version with rank-one and rank-mu
+ * covariance updates): OPTIMIZER = CMAES in ga.rcp. lambda is the
+ * population size, mu half of it, and genes are searched in coordinates
+ * scaled to [0,1] by the gene limits, starting from the weighted mean of
+ * the initial population's best half with a step size of CMAES_SIGMA
+ * (default 0.3). Samples that land outside the limits are clamped, and
+ * the clamped point is the one the update learns from.
+ *
+ * Each generation all lambda samples go out to the fitness library in
+ * one batch, so the thread pool or remote workers evaluate them in
+ * parallel. The covariance update walks C in CMAES_BLOCK square tiles,
+ * upper triangle only, streaming the mu selected steps through each
+ * tile while it's in cache. The eigendecomposition sampling needs is
+ * only redone every 1/(10 n (c1 + cmu)) generations, when C has moved
+ * enough to matter; between times the old B and D are used.
+ *
+ * mostfit is the best individual seen so far, which CMA-ES doesn't
+ * otherwise keep in the population. The status line's rate is sigma.
+ */
+class cmaes : public optimizer {
+
+ public:
+  cmaes( population * );
+  ~cmaes( void );
+
+  void step( void );
+  void finish( void );
+  const char *name( void ) { return "CMA-ES"; }
+
+ protected:
+
+ private:
+  void sample( int, individual * );
+  void update( void );
+  void covariance( double );
+  void decompose( void );
+  void keep_score( void );
+
+  population *society;
+  int n;
+  int lambda;
+  int mu;
+
+  // Strategy constants
+  vector<double> weights;
+  double mueff, cc, cs, c1, cmu, damps, chiN;
+  int eigen_interval;
+
+  // State, in [0,1] scaled coordinates
+  vector<double> mean;
+  vector<double> previous;
+  double sigma;
+  vector<double> ps, pc;
+  vector<double> C;                 // n x n, row major
+  vector<double> B;                 // eigenvectors, in columns
+  vector<double> D;                 // square roots of the eigenvalues
+  unsigned int generations;
+  unsigned int decomposed;
+
+  vector<individual *> batch;
+  vector<double> steps;             // lambda x n, (x - mean)/sigma as evaluated
+  vector<int> rank;
+  vector<double> selected;          // mu x n, the best steps in order
+
+  individual *champion;
+};
+
+#endif
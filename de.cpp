@@ -0,0 +1,113 @@
+#include "de.h"
+#include "genome.h"
+
+#include <errno.h>
+
+differential_evolution::differential_evolution( population *society ) {
+
+  this->society = society;
+  this->size = society->last->count;
+
+  string strategy = params->has("DE_STRATEGY") ? params->getString("DE_STRATEGY") : "RAND1BIN";
+  if ( strategy == "RAND1BIN" )
+    this->best_strategy = false;
+  else if ( strategy == "CURRENT_TO_BEST1" )
+    this->best_strategy = true;
+  else {
+    fprintf(stderr, "Unknown DE_STRATEGY %s\n", strategy.c_str());
+    exit(EINVAL);
+  }
+
+  this->F  = params->has("DE_F")  ? params->getFloat("DE_F")  : 0.5f;
+  this->CR = params->has("DE_CR") ? params->getFloat("DE_CR") : 0.9f;
+
+  if ( this->size < 4 ) {
+    fprintf(stderr, "Differential evolution needs a population of at least 4, not %i\n", this->size);
+    exit(EINVAL);
+  }
+
+  // The targets stay where they are in the list from now on, so they can be held by index
+  this->best = 0;
+  individual *person = society->first;
+  for ( int i=0; i<this->size && person; i++, person = person->next ) {
+    this->targets.push_back(person);
+    this->trials.push_back(new individual());
+    if ( person->fitness < this->targets[this->best]->fitness )
+      this->best = i;
+  }
+  society->mostfit = this->targets[this->best];
+
+  return;
+}
+
+differential_evolution::~differential_evolution( void ) {
+  for ( unsigned int i=0; i<this->trials.size(); i++ )
+    delete this->trials[i];
+  return;
+}
+
+/*-- A random member other than the ones given --*/
+int differential_evolution::pick( int a, int b, int c, int d ) {
+  int r;
+  do {
+    r = randl() % this->size;
+  } while ( r == a || r == b || r == c || r == d );
+  return r;
+}
+
+void differential_evolution::step( void ) {
+
+  uint64_t span = trace_begin();
+  genome *engine = genome::current();
+  const gene_t *best = this->targets[this->best]->gene;
+
+  for ( int i=0; i<this->size; i++ ) {
+    const gene_t *target = this->targets[i]->gene;
+    int r1 = this->pick(i);
+    int r2 = this->pick(i, r1);
+
+    if ( this->best_strategy )
+      engine->differential(target, target, best, this->targets[r1]->gene, this->targets[r2]->gene,
+			   this->F, this->F, this->CR, this->trials[i]->gene);
+    else {
+      int r3 = this->pick(i, r1, r2);
+      const gene_t *base = this->targets[r1]->gene;
+      engine->differential(target, base, base, this->targets[r2]->gene, this->targets[r3]->gene,
+			   0.0f, this->F, this->CR, this->trials[i]->gene);
+    }
+    this->trials[i]->cutoff = this->targets[i]->fitness;
+  }
+  span = trace_mark("trials", span);
+
+  optimizer::evaluate(this->trials);
+  span = trace_mark("evaluation", span);
+
+  // Selection in place: a trial at least as fit as its target takes over. One that was cut off
+  // is worse than its target whatever its lower bound rounded to
+  for ( int i=0; i<this->size; i++ ) {
+    individual *target = this->targets[i];
+    individual *trial = this->trials[i];
+    if ( !trial->bounded && trial->fitness <= target->fitness ) {
+      memcpy(target->gene, trial->gene, target->nGenes*sizeof(gene_t));
+      target->fitness = trial->fitness;
+      target->generation = 0;
+      if ( target->fitness < this->targets[this->best]->fitness )
+	this->best = i;
+    } else
+      target->generation++;
+  }
+  trace_end("selection", span);
+
+  this->society->generation++;
+  this->society->get_statistics();
+  this->society->mostfit = this->targets[this->best];
+
+  return;
+}
+
+/*-- Sorted at last, for the final output and dump() --*/
+void differential_evolution::finish( void ) {
+  this->society->sort();
+  this->society->check_for_clones();
+  return;
+}
@@ -0,0 +1,49 @@
+#ifndef __DE_H
+#define __DE_H
+
+#include "optimizer.h"
+
+#include <vector>
+
+using namespace std;
+
+/*
+ * Differential evolution: OPTIMIZER = DE in ga.rcp, with
+ *
+ *   string DE_STRATEGY = RAND1BIN           or CURRENT_TO_BEST1
+ *   float  DE_F = 0.5                       differential weight
+ *   float  DE_CR = 0.9                      crossover rate
+ *
+ * Every generation each member of the population gets a trial vector
+ * (genome::differential() does the gene level work), all of them are
+ * evaluated as one batch, and each trial replaces its target in place if
+ * it's at least as fit. The population is never copied or sorted until
+ * finish(); mostfit is kept track of as trials are accepted.
+ */
+class differential_evolution : public optimizer {
+
+ public:
+  differential_evolution( population * );
+  ~differential_evolution( void );
+
+  void step( void );
+  void finish( void );
+  const char *name( void ) { return this->best_strategy ? "DE current-to-best/1/bin" : "DE rand/1/bin"; }
+
+ protected:
+
+ private:
+  int pick( int, int = -1, int = -1, int = -1 );
+
+  population *society;
+  int size;
+  bool best_strategy;
+  float F;
+  float CR;
+
+  vector<individual *> targets;
+  vector<individual *> trials;
+  int best;
+};
+
+#endif
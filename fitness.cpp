@@ -1,64 +1,524 @@
 #include <fitness.h>
+#include "remote.h"
+#include "trace.h"
+#include "plugin.h"
+
+#include <atomic>
+#include <deque>
+#include <dlfcn.h>
+#include <time.h>
 
 #include "test_fitness.cpp" 
 #include "vckm.cpp"
 
 static void (*outFunc)( void * );
 static void (*fitFunc)( void * );
+static void (*evalFunc)( void * );
 static threadpool *pool;
+static remotepool *remote;
 static unsigned short Nthreads;
+
+/*-- Evaluations handed out and finished, kept only when metrics are exported --*/
+static bool counting;
+static atomic<unsigned long> dispatched(0);
+static atomic<unsigned long> evaluated(0);
+
+/*
+ * PIPELINE: evaluations go to the pool one at a time as they're handed
+ * over, each taking the queue lock for its own enqueue rather than being
+ * held back by one around the batch, and whoever waits for them takes the ones
+ * the pool hasn't got to yet, from the far end, rather than sitting
+ * idle. Each goes through the pool as an entry that the pool thread and
+ * the waiter race to claim, so every evaluation still happens once.
+ */
+typedef struct {
+  void *person;
+  atomic<bool> claimed;
+} pipe_entry;
+
+static bool pipelined;
+static deque<pipe_entry> piped;     // push_back leaves the entries where they are
+static unsigned long visited;       // entries the pool is done with, under pipe_lock
+static pthread_mutex_t pipe_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pipe_visited = PTHREAD_COND_INITIALIZER;
+
+/*
+ * FITNESS_PLUGIN: one or more shared objects, separated by commas,
+ * used instead of FITNESS_FUNCTION. More than one are taken as
+ * variants of the same function (scalar, SIMD, ...): each is timed on the
+ * same random individuals and the fastest is kept, the rest unloaded. A
+ * batch plugin with no remote workers to feed gets the evaluations
+ * gathered up by getFitness() and handed over by wait_for_threads(): in
+ * one call, or with a pool in one contiguous slice per pool thread.
+ *
+ * teardown() runs at exit, which needn't wait for the pool, so every
+ * evaluate() holds plugin_gate shared and teardown() takes it exclusively;
+ * anything evaluated after that is left alone, the process is on its way out.
+ */
+static const ga_plugin *plugin;
+static void *plugin_handle;
+static bool batching;
+static vector<individual *> batch;
+static __thread bool plugin_thread_ready;
+static __thread bool plugin_inside;
+static pthread_rwlock_t plugin_gate = PTHREAD_RWLOCK_INITIALIZER;
+static bool plugin_closed;
+
+typedef struct {
+  individual **person;
+  unsigned int n;
+} batch_slice;
+
+static vector<batch_slice> slices;
+static unsigned int slices_done;    // under slice_lock
+static pthread_mutex_t slice_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t slice_done = PTHREAD_COND_INITIALIZER;
+
+/*-- First use of the plugin in this thread --*/
+static inline void plugin_thread( void ) {
+  if ( !plugin_thread_ready ) {
+    if ( plugin->thread_init )
+      (*plugin->thread_init)();
+    plugin_thread_ready = true;
+  }
+  return;
+}
+
+static void plugin_evaluate( individual **person, unsigned int n ) {
+  plugin_thread();
+  pthread_rwlock_rdlock(&plugin_gate);
+  if ( !plugin_closed ) {
+    plugin_inside = true;
+    (*plugin->evaluate)(person, n);
+    plugin_inside = false;
+  }
+  pthread_rwlock_unlock(&plugin_gate);
+  return;
+}
+
+static void plugin_fitness( void *person ) {
+  individual *one = (individual *)person;
+  plugin_evaluate(&one, 1);
+  return;
+}
+
+/*-- A batch plugin's share of the batch all at once, with its trace span and count --*/
+static void batch_fitness( individual **person, unsigned int n ) {
+  uint64_t start = trace_begin();
+  plugin_evaluate(person, n);
+  trace_end("fitness", start);
+  if ( counting )
+    evaluated.fetch_add(n, memory_order_relaxed);
+  return;
+}
+
+/*-- What the pool runs for a batch plugin: one slice, then word that it's done --*/
+static void sliced_fitness( void *part ) {
+  batch_slice *b = (batch_slice *)part;
+  batch_fitness(b->person, b->n);
+
+  pthread_mutex_lock(&slice_lock);
+  slices_done++;
+  pthread_cond_signal(&slice_done);
+  pthread_mutex_unlock(&slice_lock);
+  return;
+}
+
+static void plugin_output( void *person ) {
+  (*plugin->output)((individual *)person);
+  return;
+}
+
+static void plugin_teardown( void ) {
+  // An exit() from inside evaluate() would wait on itself, and the plugin is mid call anyway
+  if ( plugin_inside )
+    return;
+
+  pthread_rwlock_wrlock(&plugin_gate);
+  plugin_closed = true;
+  if ( plugin->teardown )
+    (*plugin->teardown)();
+  pthread_rwlock_unlock(&plugin_gate);
+  return;
+}
+
+/*-- The fitness function with a trace span around it and/or a count after it --*/
+static void instrumented_fitness( void *person ) {
+  uint64_t start = trace_begin();
+  (*fitFunc)(person);
+  trace_end("fitness", start);
+  if ( counting )
+    evaluated.fetch_add(1, memory_order_relaxed);
+  return;
+}
+
+/*-- What the pool runs when pipelined: the entry's evaluation, unless the waiter got it first --*/
+static void piped_fitness( void *entry ) {
+  pipe_entry *e = (pipe_entry *)entry;
+  if ( !e->claimed.exchange(true) )
+    (*evalFunc)(e->person);
+
+  pthread_mutex_lock(&pipe_lock);
+  visited++;
+  pthread_cond_signal(&pipe_visited);
+  pthread_mutex_unlock(&pipe_lock);
+  return;
+}
+
+/*-- Load and check one plugin; NULL if its init() says it can't run here --*/
+static const ga_plugin *open_plugin( const char *path, const ga_plugin_context *context, void **handle ) {
+
+  *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if ( *handle == NULL ) {
+    fprintf(stderr, "Unable to load fitness plugin: %s\n", dlerror());
+    exit(EINVAL);
+  }
+
+  ga_plugin_entry_fn entry = (ga_plugin_entry_fn)dlsym(*handle, GA_PLUGIN_ENTRY);
+  const ga_plugin *p = entry ? (*entry)() : NULL;
+  if ( p == NULL ) {
+    fprintf(stderr, "Fitness plugin %s has no %s()\n", path, GA_PLUGIN_ENTRY);
+    exit(EINVAL);
+  }
+  if ( p->abi_version != GA_PLUGIN_ABI_VERSION ) {
+    fprintf(stderr, "Fitness plugin %s is for plugin ABI %u, this is %u\n", path, p->abi_version, GA_PLUGIN_ABI_VERSION);
+    exit(EINVAL);
+  }
+  if ( p->individual_size != sizeof(individual) || p->gene_format != GENE_FORMAT ) {
+    fprintf(stderr, "Fitness plugin %s was built with a different individual or GENE_TYPE (gene format %#x, this is %#x)\n",
+	    path, p->gene_format, GENE_FORMAT);
+    exit(EINVAL);
+  }
+  if ( !p->init || !p->evaluate || !p->output ) {
+    fprintf(stderr, "Fitness plugin %s is missing init, evaluate or output\n", path);
+    exit(EINVAL);
+  }
+  // More than one thread evaluating at once: the pool's, or one of them and a pipelined waiter
+  bool batches = p->capabilities & (GA_PLUGIN_BATCH | GA_PLUGIN_SIMD);
+  if ( (Nthreads > 1 || (Nthreads && params->PIPELINE && !batches)) && !(p->capabilities & GA_PLUGIN_THREAD_SAFE) ) {
+    fprintf(stderr, "Fitness plugin %s isn't thread safe, it can't be used with NUM_THREADS %u\n", path, Nthreads);
+    exit(EINVAL);
+  }
+
+  if ( (*p->init)(context) != 0 ) {
+    if ( params->VERBOSE > 1 )
+      fprintf(stderr, "Fitness plugin %s (%s) can't run here, skipping it\n", path, p->name);
+    dlclose(*handle);
+    return NULL;
+  }
+
+  return p;
+}
+
+/*-- Best of three, in seconds, over the sample; batched if the plugin takes batches --*/
+static double time_plugin( const ga_plugin *p, vector<individual *> &sample ) {
+
+  double best = INFINITY;
+  if ( p->thread_init )
+    (*p->thread_init)();
+
+  for ( int run=0; run<3; run++ ) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if ( p->capabilities & (GA_PLUGIN_BATCH | GA_PLUGIN_SIMD) )
+      (*p->evaluate)(&sample[0], sample.size());
+    else
+      for ( unsigned int i=0; i<sample.size(); i++ )
+	(*p->evaluate)(&sample[i], 1);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    best = min(best, (t1.tv_sec - t0.tv_sec) + 1e-9*(t1.tv_nsec - t0.tv_nsec));
+  }
+
+  return best;
+}
+
+/*
+ * Every variant FITNESS_PLUGIN lists that can run here, timed on one
+ * generation's worth of random individuals, and the fastest kept. Their
+ * genes come from their own generator seeded with SEED, so the run's
+ * random sequence is the same whichever is picked, and a variant whose
+ * fitness doesn't agree with the first one's gets a warning: it's meant
+ * to be the same function.
+ */
+static void load_plugins( const char *paths ) {
+
+  ga_plugin_context context;
+  context.params = params;
+  context.genes = params->NUMBER_OF_GENES;
+  context.objectives = params->OBJECTIVES;
+  context.threads = Nthreads;
+
+  vector<const ga_plugin *> found;
+  vector<void *> handles;
+  vector<string> names;
+
+  char *list = strdup(paths), *save = NULL;
+  for ( char *path = strtok_r(list, ",", &save); path; path = strtok_r(NULL, ",", &save) ) {
+    void *handle;
+    const ga_plugin *p = open_plugin(path, &context, &handle);
+    if ( p ) {
+      found.push_back(p);
+      handles.push_back(handle);
+      names.push_back(path);
+    }
+  }
+  free(list);
+
+  if ( found.empty() ) {
+    fprintf(stderr, "None of the fitness plugins in %s can run here\n", paths);
+    exit(EINVAL);
+  }
+
+  unsigned int chosen = 0;
+  if ( found.size() > 1 ) {
+    unsigned int seed = (unsigned int)params->SEED;
+    vector<individual *> sample(max(params->INITIAL_POPULATION, 1));
+    vector<float> reference(sample.size());
+
+    for ( unsigned int i=0; i<sample.size(); i++ ) {
+      sample[i] = new individual();
+      for ( int j=0; j<params->NUMBER_OF_GENES; j++ )
+	sample[i]->gene[j] = gene_store(params->pLO[j] +
+					(params->pHI[j] - params->pLO[j])*(rand_r(&seed)*ONE_OVER_RAND_MAX));
+    }
+
+    double fastest = INFINITY;
+    for ( unsigned int v=0; v<found.size(); v++ ) {
+      double seconds = time_plugin(found[v], sample);
+
+      for ( unsigned int i=0; i<sample.size(); i++ ) {
+	if ( v == 0 )
+	  reference[i] = sample[i]->fitness;
+	else if ( fabs(sample[i]->fitness - reference[i]) > 1e-4f*max(1.0f, fabs(reference[i])) ) {
+	  fprintf(stderr, "Warning: fitness plugin %s disagrees with %s (%g against %g)\n",
+		  names[v].c_str(), names[0].c_str(), sample[i]->fitness, reference[i]);
+	  break;
+	}
+      }
+
+      if ( params->VERBOSE > 1 )
+	fprintf(stderr, "Fitness plugin %s (%s): %.3g s for %lu individuals\n",
+		names[v].c_str(), found[v]->name, seconds, (unsigned long)sample.size());
+      if ( seconds < fastest ) {
+	fastest = seconds;
+	chosen = v;
+      }
+    }
+
+    for ( unsigned int i=0; i<sample.size(); i++ )
+      delete sample[i];
+
+    // The winner has had this thread's thread_init() already
+    plugin_thread_ready = true;
+  }
+
+  for ( unsigned int v=0; v<found.size(); v++ ) {
+    if ( v == chosen )
+      continue;
+    if ( found[v]->teardown )
+      (*found[v]->teardown)();
+    dlclose(handles[v]);
+  }
+
+  plugin = found[chosen];
+  plugin_handle = handles[chosen];
+  if ( params->VERBOSE > 1 )
+    fprintf(stderr, "Using fitness plugin %s (%s)\n", names[chosen].c_str(), plugin->name);
+
+  atexit(plugin_teardown);
+  return;
+}
+
 void initialize_fitness_library( void ) {
 
-  string FITNESS_FUNCTION = params->getString("FITNESS_FUNCTION");
-  Nthreads = params->getUInt("NUM_THREADS");
+  char *FITNESS_PLUGIN = params->getString(params->handle("FITNESS_PLUGIN", PARAM_STRING));
+  Nthreads = params->NUM_THREADS;
+
+  if ( FITNESS_PLUGIN && *FITNESS_PLUGIN ) {
+    load_plugins(FITNESS_PLUGIN);
+    fitFunc = plugin_fitness;
+    outFunc = plugin_output;
+  } else {
+    string FITNESS_FUNCTION = params->getString(params->handle("FITNESS_FUNCTION", PARAM_STRING, true));
+
+#ifdef GENE_FIXED
+    // The built in functions read gene[] as stored, which here is value*10^ACCURACY
+    fprintf(stderr, "FITNESS_FUNCTION %s reads genes as floating point, a fixed point build (gene format %#x) "
+	    "needs a FITNESS_PLUGIN built with the same GENE_TYPE\n", FITNESS_FUNCTION.c_str(), GENE_FORMAT);
+    exit(EINVAL);
+#endif
 
-  if ( FITNESS_FUNCTION == "TEST" ) {
-    initialize_test();               // Call the test init function here in case we're running 
+    if ( FITNESS_FUNCTION == "TEST" ) {
+      initialize_test();             // Call the test init function here in case we're running 
                                      // with multiple threads, otherwise it'll likely initialize
                                      // with different solutions for each thread. Which can be 
                                      // quite painful.
-    fitFunc = test_fitness;
-    outFunc = dumpTest;
-  } else if ( FITNESS_FUNCTION.compare(0, 3, "CKM", 3) == 0 ) {
-    fitFunc = ckm_fitness;
-    outFunc = dumpMatrix;
-  } else {
-    cout << "Unable to find fitness function " << FITNESS_FUNCTION << "\n";
-    exit (2);
+      fitFunc = test_fitness;
+      outFunc = dumpTest;
+    } else if ( FITNESS_FUNCTION.compare(0, 3, "CKM", 3) == 0 ) {
+      fitFunc = ckm_fitness;
+      outFunc = dumpMatrix;
+    } else {
+      cout << "Unable to find fitness function " << FITNESS_FUNCTION << "\n";
+      exit (2);
+    }
   }
 
-  // Are we going to run the fitness calculations in parallel?
+  counting = (params->METRICS_FILE && *params->METRICS_FILE) || params->METRICS_PORT > 0;
+  evalFunc = ( trace || counting ) ? instrumented_fitness : fitFunc;
+
+  // Are we going to farm the fitness calculations out to ga_worker processes?
+  if ( params->WORKERS && *params->WORKERS ) {
+    float heartbeat = params->getFloat(params->handle("REMOTE_HEARTBEAT", PARAM_DOUBLE));
+    float timeout   = params->getFloat(params->handle("REMOTE_TIMEOUT", PARAM_DOUBLE));
+
+    remote = new remotepool( params->WORKERS,
+			     params->getUInt(params->handle("REMOTE_BATCH_SIZE", PARAM_INT)),
+			     params->getUInt(params->handle("REMOTE_PIPELINE_DEPTH", PARAM_INT)),
+			     (heartbeat > 0.0f) ? heartbeat : 1.0,
+			     (timeout > 0.0f) ? timeout : 30.0 );
+    return;
+  }
+
+  // A batch plugin gets whole batches, or slices of them, which makes them asynchronous too
+  batching = plugin && (plugin->capabilities & (GA_PLUGIN_BATCH | GA_PLUGIN_SIMD));
+  if ( batching )
+    params->ASYNC_FITNESS = true;
+
+  // Are we going to run the fitness calculations in parallel? Batches aren't pipelined
+  pipelined = params->PIPELINE && Nthreads && !batching;
   if ( Nthreads )
-    pool = new threadpool( fitFunc, Nthreads );
+    pool = new threadpool( batching ? sliced_fitness : pipelined ? piped_fitness : evalFunc, Nthreads );
 
   return;
 }
 
 void getFitness( void *person ) {
 
-  if ( Nthreads )
+  ((individual *)person)->bounded = false;
+  ((individual *)person)->estimated = false;
+  if ( counting )
+    dispatched.fetch_add(1, memory_order_relaxed);
+
+  if ( remote )
+    remote->enqueue(person);
+  else if ( batching )
+    batch.push_back((individual *)person);
+  else if ( pipelined ) {
+    piped.emplace_back();
+    pipe_entry &e = piped.back();
+    e.person = person;
+    e.claimed = false;
+    // The pool's dequeue only holds read_lock, so without it this could
+    // push while a pool thread pops, or decides to sleep on an empty queue
+    pool->queue_lock();
+    pool->enqueue(&e);
+    pool->queue_unlock();
+  } else if ( Nthreads )
     pool->enqueue(person);
   else
-    (*fitFunc)(person);
+    (*evalFunc)(person);
   return;
 
 }
 
+/*-- Straight through in the calling thread, for callers with threads of their own --*/
+void evaluateFitness( void *person ) {
+
+  ((individual *)person)->bounded = false;
+  ((individual *)person)->estimated = false;
+  if ( counting )
+    dispatched.fetch_add(1, memory_order_relaxed);
+
+  (*evalFunc)(person);
+  return;
+}
+
 void lock(void) {
+  if ( remote || pipelined || batching )
+    return;
   pool->queue_lock();
   return;
 }
 
 void unlock(void) {
+  if ( remote || pipelined || batching )
+    return;
   pool->queue_unlock();
   return;
 }
 
 void wait_for_threads( void ) {
-  pool->wait_until_empty();
+  if ( remote ) {
+    remote->wait_until_empty();
+    // Remote results arrive a batch at a time, count them when they're all in
+    if ( counting )
+      evaluated.store(dispatched.load());
+
+  } else if ( batching ) {
+    if ( batch.empty() )
+      return;
+
+    if ( !Nthreads )
+      batch_fitness(&batch[0], batch.size());
+    else {
+      // One contiguous slice per pool thread, as near the same size as they'll go
+      unsigned int parts = min((size_t)Nthreads, batch.size());
+      slices.resize(parts);
+      for ( unsigned int i=0; i<parts; i++ ) {
+	size_t from = i*batch.size()/parts, to = (i+1)*batch.size()/parts;
+	slices[i].person = &batch[from];
+	slices[i].n = to - from;
+      }
+
+      pool->queue_lock();
+      for ( unsigned int i=0; i<parts; i++ )
+	pool->enqueue(&slices[i]);
+      pool->queue_unlock();
+
+      pthread_mutex_lock(&slice_lock);
+      while ( slices_done < parts )
+	pthread_cond_wait(&slice_done, &slice_lock);
+      slices_done = 0;
+      pthread_mutex_unlock(&slice_lock);
+    }
+    batch.clear();
+
+  } else if ( pipelined ) {
+    // Whatever the pool hasn't started, this thread does itself
+    for ( size_t i = piped.size(); i-- > 0; )
+      if ( !piped[i].claimed.exchange(true) )
+	(*evalFunc)(piped[i].person);
+
+    // Then the ones already running; once the pool has let go of every entry they can go
+    pthread_mutex_lock(&pipe_lock);
+    while ( visited < piped.size() )
+      pthread_cond_wait(&pipe_visited, &pipe_lock);
+    visited = 0;
+    pthread_mutex_unlock(&pipe_lock);
+    piped.clear();
+
+  } else
+    pool->wait_until_empty();
   return;
 }
 
+/*-- Only a plugin that says so fills in objectives; TEST and CKM have just the one --*/
+bool fitness_objectives( void ) {
+  return plugin && (plugin->capabilities & GA_PLUGIN_OBJECTIVES);
+}
+
+/*-- For the metrics exporter: evaluations finished, and handed out but not finished --*/
+unsigned long fitness_evaluations( void ) {
+  return evaluated.load(memory_order_relaxed);
+}
+
+unsigned long fitness_pending( void ) {
+  unsigned long done = evaluated.load(memory_order_relaxed);
+  unsigned long out = dispatched.load(memory_order_relaxed);
+  return out > done ? out - done : 0;
+}
+
 void outputIndividual( void *person ) {
   (*outFunc)(person);
   return;
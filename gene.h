@@ -0,0 +1,57 @@
+#ifndef __GENE_H
+#define __GENE_H
+
+#include <stdint.h>
+
+/*
+ * Gene storage, picked at build time with GENE_TYPE in the Makefile:
+ *
+ *   float    (default)
+ *   double
+ *   fixed16  int16_t holding value*10^ACCURACY
+ *   fixed32  int32_t holding value*10^ACCURACY
+ *
+ * Fixed point genes move a half or a quarter of the bytes through the
+ * cache, and two genes that print the same are bitwise equal, which
+ * makes clone detection exact. Anything that isn't individual or genome
+ * should read genes with gene_value() and write them with gene_store();
+ * for float and double both compile away.
+ */
+#if defined(GENE_DOUBLE)
+typedef double gene_t;
+#define GENE_FORMAT 0x108
+#elif defined(GENE_FIXED16)
+typedef int16_t gene_t;
+#define GENE_FIXED
+#define GENE_FORMAT 0x202
+#elif defined(GENE_FIXED32)
+typedef int32_t gene_t;
+#define GENE_FIXED
+#define GENE_FORMAT 0x204
+#else
+typedef float gene_t;
+#define GENE_FORMAT 0x104
+#endif
+
+/*
+ * GENE_FORMAT is (kind << 8) | bytes, kind 1 for floating point and 2 for
+ * fixed point. It goes into checkpoints, population files and the worker
+ * handshake so genes are never read back as the wrong type. Files from
+ * before it existed carry 0, which means float.
+ */
+#define GENE_FORMAT_LEGACY 0x104
+
+extern double gene_quantum;      // value of one fixed point step, 10^-ACCURACY
+extern double gene_steps;        // steps per unit, 10^ACCURACY
+
+#ifdef GENE_FIXED
+inline double gene_value( gene_t g ) { return g*gene_quantum; }
+inline gene_t gene_store( double x ) { return (gene_t)(x*gene_steps + (x < 0.0 ? -0.5 : 0.5)); }
+#else
+inline gene_t gene_value( gene_t g ) { return g; }
+inline gene_t gene_store( double x ) { return (gene_t)x; }
+#endif
+
+void gene_setup( void );
+
+#endif
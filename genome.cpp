@@ -0,0 +1,42 @@
+#include "genome.h"
+
+#include <stdio.h>
+
+genome *genome::engine = NULL;
+
+/*-- Gene counts that get their own fully specialized engines --*/
+#define GENOME_SIZES(SIZE)						\
+  SIZE(1) SIZE(2) SIZE(3) SIZE(4) SIZE(5) SIZE(6) SIZE(8) SIZE(10)	\
+  SIZE(12) SIZE(16) SIZE(20) SIZE(24) SIZE(32) SIZE(48) SIZE(64) SIZE(128)
+
+#define GENOME_CASE(n)							\
+  case n:								\
+    chosen = simple ?							\
+      (genome *)new genome_engine< n, gene_t, replace_mutation >() :	\
+      (genome *)new genome_engine< n, gene_t, bitflip_mutation >();	\
+    break;
+
+/*-- Pick the engine for this many genes, falling back on the run time sized one --*/
+genome *genome::select( int nGenes, bool simple ) {
+
+  genome *chosen = NULL;
+  switch ( nGenes ) {
+    GENOME_SIZES(GENOME_CASE)
+  default:
+    chosen = simple ?
+      (genome *)new genome_engine< 0, gene_t, replace_mutation >() :
+      (genome *)new genome_engine< 0, gene_t, bitflip_mutation >();
+    nGenes = 0;
+  }
+
+  if ( params->VERBOSE > 1 ) {
+    if ( nGenes )
+      fprintf(stderr, "Using the %i gene %s engine\n", nGenes, chosen->name());
+    else
+      fprintf(stderr, "Using the general %s engine\n", chosen->name());
+  }
+
+  delete engine;
+  engine = chosen;
+  return chosen;
+}
@@ -0,0 +1,225 @@
+#ifndef __GENOME_H
+#define __GENOME_H
+
+#include "global.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+using namespace std;
+
+/*-- Limits on self-adapted mutation rates --*/
+#define MUTATION_RATE_MIN  0.001f
+#define MUTATION_RATE_MAX  0.5f
+
+/*
+ * The gene level work behind individual: crossover, mutation, clone
+ * comparison and differential evolution's trial vectors. genome_engine is
+ * compiled separately for the common gene counts (N > 0), where every loop
+ * has a constant trip count and the compiler can unroll and vectorize it;
+ * N = 0 is the general version that reads the gene count at run time.
+ * genome::select() picks one at start up and individual goes through it
+ * with one virtual call per operation.
+ *
+ * T is gene_t (gene.h); it's a template parameter so the kernels don't
+ * care which one the build picked.
+ *
+ * Every engine consumes random numbers in exactly the same order, so the
+ * choice of engine never changes the course of a run.
+ */
+class genome {
+
+ public:
+  virtual ~genome( void ) {}
+
+  virtual void crossover( const gene_t *, const gene_t *, gene_t * ) = 0;
+  virtual void mutate( gene_t *, float ) = 0;
+  virtual void differential( const gene_t *, const gene_t *, const gene_t *, const gene_t *, const gene_t *,
+			     float, float, float, gene_t * ) = 0;
+  virtual bool same( const gene_t *, const gene_t * ) = 0;
+  virtual const char *name( void ) = 0;
+
+  static genome *select( int, bool );
+
+  /*
+   * Self-adaptation, the way evolution strategies do it: a child's
+   * mutation rate is its parents' geometric mean times exp(tau*N(0,1)),
+   * tau being MUTATION_TAU. Rates that make fit children are passed on
+   * with them. A rate of 0 (mutation turned off) stays 0.
+   */
+  static inline float adapt( float daddy, float mommy ) {
+    if ( daddy <= 0.0f || mommy <= 0.0f )
+      return 0.0f;
+
+    float rate = sqrtf(daddy*mommy)*expf(params->MUTATION_TAU*randn());
+    if ( rate < MUTATION_RATE_MIN )
+      rate = MUTATION_RATE_MIN;
+    else if ( rate > MUTATION_RATE_MAX )
+      rate = MUTATION_RATE_MAX;
+    return rate;
+  }
+
+  /*-- Whatever main() selected, or the general engine if nobody did --*/
+  static inline genome *current( void ) {
+    return engine ? engine : select(0, params->MUTATE_SIMPLE);
+  }
+
+ protected:
+  static genome *engine;
+};
+
+/*-- An unsigned integer as wide as T, for flipping T's bits --*/
+template < int BYTES > struct genome_bits;
+template <> struct genome_bits<2> { typedef uint16_t type; };
+template <> struct genome_bits<4> { typedef uint32_t type; };
+template <> struct genome_bits<8> { typedef uint64_t type; };
+
+/*
+ * Operator sets. Each is a policy with a single mutate() kernel, n being
+ * either the compile time N or the run time gene count, and rate the
+ * mutating individual's own mutation rate.
+ */
+
+/*-- Flip random bits in random genes, keeping only the flips that stay in bounds --*/
+struct bitflip_mutation {
+
+  static const char *name( void ) { return "bitflip"; }
+
+  template < class T >
+  static inline void mutate( T *gene, const int n, const float rate ) {
+
+    typedef typename genome_bits<sizeof(T)>::type bits;
+    const unsigned long int number_of_bits = 8*sizeof(T);
+
+    float probability_per_bit  = rate/((float)number_of_bits);
+    float probability_per_gene = rate/((float)n);
+    const double *lo = params->pLO;
+    const double *hi = params->pHI;
+
+    for ( int i=0; i<n; i++ ) {
+
+      if ( randf() < probability_per_gene ) {
+
+	unsigned short int which = (unsigned short int)(randf()*number_of_bits);
+
+	bits *pattern = (bits *)&gene[i];
+	T saveParam = gene[i];
+
+	*pattern ^= ((bits)1<<which);
+
+	while ( randf() < probability_per_bit ) {
+	  which = (unsigned short int)randf()*number_of_bits;
+	  *pattern ^= ((bits)1<<which);
+	}
+
+	bool stillborn = gene_value(gene[i]) != gene_value(gene[i]) ||
+	  fabs(gene_value(gene[i])) == INFINITY ||
+	  gene_value(gene[i]) < lo[i] || gene_value(gene[i]) > hi[i];
+
+	if ( stillborn ) {
+	  gene[i] = saveParam;
+	  i--;
+	}
+      }
+    }
+
+    return;
+  }
+};
+
+/*-- MUTATE_SIMPLE: replace whole genes with fresh random values --*/
+struct replace_mutation {
+
+  static const char *name( void ) { return "replace"; }
+
+  template < class T >
+  static inline void mutate( T *gene, const int n, const float rate ) {
+    while ( randf() < rate ) {
+      unsigned int which = randl() % n;
+      gene[which] = gene_store(params->pLO[which] + randf()*(params->pHI[which] - params->pLO[which]));
+    }
+    return;
+  }
+};
+
+template < int N, class T, class OPS >
+class genome_engine : public genome {
+
+ public:
+
+  /*-- Pairs of genes come from alternating parents --*/
+  void crossover( const gene_t *daddy, const gene_t *mommy, gene_t *baby ) {
+    const int n = size();
+
+    for ( int i=0; i<n; i+=2 ) {
+      const T *first  = mommy;
+      const T *second = daddy;
+      if ( randf() > 0.50f ) {
+	first  = daddy;
+	second = mommy;
+      }
+      baby[i] = first[i];
+      if ( i+1 < n )
+	baby[i+1] = second[i+1];
+    }
+
+    return;
+  }
+
+  void mutate( gene_t *gene, float rate ) {
+    OPS::mutate(gene, size(), rate);
+    return;
+  }
+
+  /*
+   * Differential evolution's trial vector: the mutant
+   *
+   *   base + K*(best - base) + F*(r1 - r2)
+   *
+   * (rand/1 is K = 0, current-to-best/1 is base = target, K = F), crossed
+   * binomially with target at rate CR, with at least one gene from the
+   * mutant. Mutant genes outside the limits are put half way between the
+   * target's and the limit. The random draws come first, in a loop of
+   * their own, so the arithmetic is one branch free pass the compiler can
+   * vectorize, with a constant trip count in the fixed size versions.
+   */
+  void differential( const gene_t *target, const gene_t *base, const gene_t *best,
+		     const gene_t *r1, const gene_t *r2, float K, float F, float CR, gene_t *trial ) {
+    const int n = size();
+    const double *lo = params->pLO;
+    const double *hi = params->pHI;
+
+    bool take[n];
+    int forced = randl() % n;
+    for ( int i=0; i<n; i++ )
+      take[i] = randf() < CR || i == forced;
+
+    for ( int i=0; i<n; i++ ) {
+      double b = gene_value(base[i]);
+      double t = gene_value(target[i]);
+      double v = b + K*(gene_value(best[i]) - b) + F*(gene_value(r1[i]) - gene_value(r2[i]));
+      v = v < lo[i] ? 0.5*(t + lo[i]) : v;
+      v = v > hi[i] ? 0.5*(t + hi[i]) : v;
+      trial[i] = take[i] ? gene_store(v) : target[i];
+    }
+
+    return;
+  }
+
+  /*-- No early exit, so the fixed size versions compare in straight line code --*/
+  bool same( const gene_t *a, const gene_t *b ) {
+    const int n = size();
+    int differ = 0;
+    for ( int i=0; i<n; i++ )
+      differ |= a[i] != b[i];
+    return !differ;
+  }
+
+  const char *name( void ) { return OPS::name(); }
+
+ private:
+  inline int size( void ) { return N ? N : params->NUMBER_OF_GENES; }
+};
+
+#endif
@@ -5,7 +5,9 @@
 #define GLIB_VERSION_MIN_REQUIRED GLIB_VERSION_2_26
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <parameters.h>
+#include <gene.h>
 #include <limits>
 
 #define MAX_UL_INT 0xffffffff
@@ -13,10 +15,31 @@
 const float ONE_OVER_RAND_MAX = 1/(RAND_MAX + 1.0f);
 const float INFINITY = numeric_limits<float>::infinity();
 
+#include <math.h>                   // only now, it has an INFINITY of its own
+
 extern parameters *params;
 
+/*-- Threads breeding on their own (steady state) draw from a generator of their own --*/
+extern __thread struct random_data *thread_random;
+
+inline long randl() {
+  if ( thread_random ) {
+    int32_t r;
+    random_r(thread_random, &r);
+    return r;
+  }
+  return random();
+}
+
 inline float randf() {
-  return ONE_OVER_RAND_MAX*random();
+  return ONE_OVER_RAND_MAX*randl();
+}
+
+/*-- Standard normal deviate (Box-Muller); u is never 0, so the log is finite --*/
+inline float randn() {
+  double u = (randl() + 1.0)/(RAND_MAX + 2.0);
+  double v = randf();
+  return sqrt(-2.0*log(u))*cos(2.0*M_PI*v);
 }
 
 #endif
@@ -44,11 +44,6 @@
 /** Maximal size of a name in the PATH */
 #define PATH_MAXNAMESZ       4096
 
-/** Define P_tmpdir if not defined (this is normally a POSIX symbol) */
-#ifndef P_tmpdir
-#define P_tmpdir "."
-#endif
-
 /*---------------------------------------------------------------------------
                             Function codes
  ---------------------------------------------------------------------------*/
@@ -174,7 +169,6 @@ gnuplot_ctrl * GnuPlot::gnuplot_init(void) {
      */
     handle = (gnuplot_ctrl*)malloc(sizeof(gnuplot_ctrl)) ;
     handle->nplots = 0 ;
-    handle->ntmp = 0 ;
 
     handle->gnucmd = popen("gnuplot", "w") ;
     if (handle->gnucmd == NULL) {
@@ -192,25 +186,19 @@ gnuplot_ctrl * GnuPlot::gnuplot_init(void) {
   @param	handle Gnuplot session control handle.
   @return	void
 
-  Kills the child PID and deletes all opened temporary files.
-  It is mandatory to call this function to close the handle, otherwise
-  temporary files are not cleaned and child process might survive.
+  Closes the pipe and waits for gnuplot to exit. It is mandatory to call
+  this function to close the handle, otherwise the child process might
+  survive.
 
  */
 /*--------------------------------------------------------------------------*/
 
 void GnuPlot::gnuplot_close(void) {
-    int     i ;
 
     if (pclose(this->plot_ctrl->gnucmd) == -1) {
         fprintf(stderr, "problem closing communication to gnuplot\n") ;
         return ;
     }
-    if (this->plot_ctrl->ntmp) {
-        for (i=0 ; i<this->plot_ctrl->ntmp ; i++) {
-            remove(this->plot_ctrl->to_delete[i]) ;
-        }
-    }
     free(this->plot_ctrl) ;
     return ;
 }
@@ -366,17 +354,36 @@ void GnuPlot::gnuplot_set_ylabel(char * label) {
 /*--------------------------------------------------------------------------*/
 
 void GnuPlot::gnuplot_resetplot(void) {
-  int     i ;
-  if (this->plot_ctrl->ntmp) {
-    for (i=0 ; i<this->plot_ctrl->ntmp ; i++) {
-      remove(this->plot_ctrl->to_delete[i]) ;
-    }
-  }
-  this->plot_ctrl->ntmp = 0 ;
   this->plot_ctrl->nplots = 0 ;
   return ;
 }
 
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Plot (or replot) a named datablock already sent to gnuplot.
+  @param	data	Datablock name, $GP0, $GP1, ...
+  @param	title	Title of the plot.
+  @return	void
+
+  Data goes down the pipe inline as a datablock (gnuplot 5 or newer)
+  rather than through temporary files. Datablocks stay defined in the
+  gnuplot session, so replot sees every dataset of the current plot.
+ */
+/*--------------------------------------------------------------------------*/
+void GnuPlot::gnuplot_plot_data( const char * data, char * title ) {
+  const char *cmd = (this->plot_ctrl->nplots > 0) ? "replot" : "plot";
+
+  if (title == NULL)
+    fprintf(this->plot_ctrl->gnucmd, "%s %s with %s\n", cmd, data, this->plot_ctrl->pstyle) ;
+  else
+    fprintf(this->plot_ctrl->gnucmd, "%s %s title \"%s\" with %s\n", cmd, data,
+	    title, this->plot_ctrl->pstyle) ;
+
+  fflush(this->plot_ctrl->gnucmd) ;
+  this->plot_ctrl->nplots++ ;
+  return ;
+}
+
 /*-------------------------------------------------------------------------*/
 /**
   @brief	Plots a 2d graph from a list of doubles.
@@ -410,55 +417,18 @@ void GnuPlot::gnuplot_resetplot(void) {
 void GnuPlot::gnuplot_plot_x( double *d, int n, char *title ) {
 
   int     i ;
-  int     tmpfd ;
-  char    name[128] ;
-  char    cmd[GP_CMD_SIZE] ;
-  char    line[GP_CMD_SIZE] ;
+  char    name[32] ;
 
   if (this->plot_ctrl==NULL || d==NULL || (n<1)) return ;
 
-  /* Open one more temporary file? */
-  if (this->plot_ctrl->ntmp == GP_MAX_TMP_FILES - 1) {
-    fprintf(stderr,
-	    "maximum # of temporary files reached (%d): cannot open more",
-	    GP_MAX_TMP_FILES) ;
-    return ;
-  }
-
-  /* Open temporary file for output   */
-  sprintf(name, "%s/gnuplot-i-XXXXXX", P_tmpdir);
-  if ((tmpfd=mkstemp(name))==-1) {
-    fprintf(stderr,"cannot create temporary file: exiting plot") ;
-    return ;
-  }
-
-  /* Store file name in array for future deletion */
-  strcpy(this->plot_ctrl->to_delete[this->plot_ctrl->ntmp], name) ;
-  this->plot_ctrl->ntmp ++ ;
-  /* Write data to this file  */
-  for (i=0 ; i<n ; i++) {
-    sprintf(line, "%g\n", d[i]);
-    write(tmpfd, line, strlen(line));
-  }
-  close(tmpfd) ;
-
-  /* Command to be sent to gnuplot    */
-  if (this->plot_ctrl->nplots > 0) {
-    strcpy(cmd, "replot") ;
-  } else {
-    strcpy(cmd, "plot") ;
-  }
-
-  if (title == NULL) {
-    sprintf(line, "%s \"%s\" with %s", cmd, name, this->plot_ctrl->pstyle) ;
-  } else {
-    sprintf(line, "%s \"%s\" title \"%s\" with %s", cmd, name,
-	    title, this->plot_ctrl->pstyle) ;
-  }
+  /* Stream the data inline, through stdio's buffer rather than a write per point */
+  sprintf(name, "$GP%d", this->plot_ctrl->nplots) ;
+  fprintf(this->plot_ctrl->gnucmd, "%s << EOD\n", name) ;
+  for (i=0 ; i<n ; i++)
+    fprintf(this->plot_ctrl->gnucmd, "%g\n", d[i]) ;
+  fputs("EOD\n", this->plot_ctrl->gnucmd) ;
 
-  /* send command to gnuplot  */
-  gnuplot_cmd(line) ;
-  this->plot_ctrl->nplots++ ;
+  gnuplot_plot_data(name, title) ;
   return ;
 }
 
@@ -495,63 +465,20 @@ void GnuPlot::gnuplot_plot_x( double *d, int n, char *title ) {
 /*--------------------------------------------------------------------------*/
 
 void GnuPlot::gnuplot_plot_xy( double *x, double *y, int n, char *title ) {
- 
+
   int     i ;
-  int     tmpfd ;
-  char    name[128] ;
-  char    cmd[GP_CMD_SIZE] ;
-  char    line[GP_CMD_SIZE] ;
+  char    name[32] ;
 
   if (this->plot_ctrl==NULL || x==NULL || y==NULL || (n<1)) return ;
 
-  /* Open one more temporary file? */
-  if (this->plot_ctrl->ntmp == GP_MAX_TMP_FILES - 1) {
-    fprintf(stderr,
-	    "maximum # of temporary files reached (%d): cannot open more",
-	    GP_MAX_TMP_FILES) ;
-    return ;
-  }
-
-  /* Open temporary file for output */
-  sprintf(name, "%s/gnuplot-i-XXXXXX", P_tmpdir);
-  if ((tmpfd=mkstemp(name))==-1) {
-    fprintf(stderr,"\ncannot create temporary file: exiting plot\n") ;
-    return ;
-  }
-
-  /* Store file name in array for future deletion */
-  strcpy(this->plot_ctrl->to_delete[this->plot_ctrl->ntmp], name) ;
-  this->plot_ctrl->ntmp ++ ;
-
-  /* Write data to this file  */
-  for (i=0 ; i<n; i++) {
-    sprintf(line, "%g %g\n", x[i], y[i]) ;
-    uint bytes = write(tmpfd, line, strlen(line));
-    if ( bytes != strlen(line) ) {
-      fprintf(stderr, "Write failed: %s", line);
-      return;
-    }
-  }
-  close(tmpfd) ;
-
-  /* Command to be sent to gnuplot    */
-  if (this->plot_ctrl->nplots > 0) {
-    strcpy(cmd, "replot") ;
-  } else {
-    strcpy(cmd, "plot") ;
-  }
-  
-  if (title == NULL) {
-    sprintf(line, "%s \"%s\" with %s", cmd, name, this->plot_ctrl->pstyle) ;
-  } else {
-    sprintf(line, "%s \"%s\" title \"%s\" with %s", cmd, name,
-	    title, this->plot_ctrl->pstyle) ;
-  }
-
-  /* send command to gnuplot  */
-  gnuplot_cmd(line) ;
+  /* Stream the data inline, through stdio's buffer rather than a write per point */
+  sprintf(name, "$GP%d", this->plot_ctrl->nplots) ;
+  fprintf(this->plot_ctrl->gnucmd, "%s << EOD\n", name) ;
+  for (i=0 ; i<n ; i++)
+    fprintf(this->plot_ctrl->gnucmd, "%g %g\n", x[i], y[i]) ;
+  fputs("EOD\n", this->plot_ctrl->gnucmd) ;
 
-  this->plot_ctrl->nplots++ ;
+  gnuplot_plot_data(name, title) ;
   return ;
 }
 
@@ -709,54 +636,52 @@ void GnuPlot::gnuplot_plot_equation( char *equation, char *title ) {
 /*-------------------------------------------------------------------------*/
 /**
   @brief	Plot a histogram of a dataset
-  @param	ordinate        x-values for the histogram
+  @param	ordinate        x-values for the histogram, evenly spaced
   @param        rawdata         y-values of the data
+  @param        n               number of values in rawdata
   @param        nbins           number of bins for the histogram
   @param        overflow        include data outside the ordinate range?
   @param	title		Title of the plot.
   @return	void
 
-  generates a histogram in the range [ordinate[0], ordinate[nbins-1]) from
-  the raw data passed in. 
+  generates a histogram of all n values in the range
+  [ordinate[0], ordinate[nbins-1] + bin width) from the raw data passed
+  in. Each value goes straight to its bin, so this is O(n).
 
 **/
 /*--------------------------------------------------------------------------*/
-void GnuPlot::gnuplot_plot_histogram( double *ordinate, double *rawdata, 
-				      const unsigned int nbins,
+void GnuPlot::gnuplot_plot_histogram( double *ordinate, double *rawdata,
+				      unsigned int n, const unsigned int nbins,
 				      int overflow, char * title ) {
-  unsigned int i, j=0;
-  double bin[nbins];
 
-  // Zero all the bins.. otherwise we'll get NaNs in any empty bins
-  memset(bin, 0, nbins*sizeof(double));
-
-  if ( !rawdata )
+  if ( !rawdata || !ordinate || nbins < 2 )
     return;
 
-  // build the histogram bin values out of the raw data
-  while ( j<nbins && rawdata[j] ) {
-
-    for ( i=0; i<nbins-1; i++ ) {
-      if ( overflow ) {
-	if ( rawdata[j] <= ordinate[0] ) {
-	  bin[0]++;
-	} else if ( rawdata[j] >= ordinate[nbins-1] ) {
-	  bin[nbins-1]++;
-	} else if ( rawdata[j] >= ordinate[i] && rawdata[j] < ordinate[i+1] ) {
-	  bin[i]++;
-	}
-      } else {
-	if ( rawdata[j] >= ordinate[i] && rawdata[j] < ordinate[i+1] ) {
-	  bin[i]++;
-	}
-      }
-    }
-    j++;
-  }
+  double width = ordinate[1] - ordinate[0];
+  histogram h( nbins, ordinate[0], ordinate[nbins-1] + width, overflow );
+  h.add(rawdata, n);
+
+  gnuplot_plot_histogram(h, title);
+  return;
+}
+
+/*-------------------------------------------------------------------------*/
+/**
+  @brief	Plot a histogram that has already been filled
+  @param	h		The histogram, bins plotted at their lower edges
+  @param	title		Title of the plot.
+  @return	void
+**/
+/*--------------------------------------------------------------------------*/
+void GnuPlot::gnuplot_plot_histogram( histogram & h, char * title ) {
+
+  unsigned int nbins = h.size();
+  double x[nbins];
+  for ( unsigned int i=0; i<nbins; i++ )
+    x[i] = h.lower_edge(i);
 
-  // Now that the counters are set up... make an xy plot out of it
   gnuplot_setstyle((char *)"boxes");
-  gnuplot_plot_xy(ordinate, bin, nbins, title);
+  gnuplot_plot_xy(x, h.counts(), nbins, title);
 
   return;
 }
@@ -15,10 +15,7 @@
 #include <stdarg.h>
 #include <fcntl.h>
 
-/** Maximal number of simultaneous temporary files */
-#define GP_MAX_TMP_FILES    64
-/** Maximal size of a temporary file name */
-#define GP_TMP_NAME_SIZE    512
+#include "histogram.h"
 
 /*---------------------------------------------------------------------------
                                 New Types
@@ -35,12 +32,6 @@ typedef struct _GNUPLOT_CTRL_ {
   /** Current plotting style */
   char      pstyle[32] ;
 
-  /** Name of temporary files */
-  char      to_delete[GP_MAX_TMP_FILES][GP_TMP_NAME_SIZE] ;
-
-  /** Number of temporary files */
-  int       ntmp ;
-
 } gnuplot_ctrl;
 
 /* Class declaration */
@@ -67,16 +58,18 @@ public:
   void gnuplot_set_ylabel(char * label);
   void gnuplot_set_title(char * title);
   void gnuplot_resetplot(void);
+  void gnuplot_plot_data( const char * data, char * title );
   void gnuplot_plot_x(double * d, int n, char * title);
   void gnuplot_plot_xy( double *x, double *y, int n, char *title );
   void gnuplot_plot_once( char *title, char *style, char *label_x,
 			 char *label_y, double *x, double *y, int n );
   void gnuplot_plot_slope( double a, double b, char *title );
   void gnuplot_plot_equation(char * equation, char * title) ;
-  void gnuplot_plot_histogram( double *ordinate, double *rawdata, 
-			       const unsigned int nbins,
+  void gnuplot_plot_histogram( double *ordinate, double *rawdata,
+			       unsigned int n, const unsigned int nbins,
 			       int overflow, char * title
 			       );
+  void gnuplot_plot_histogram( histogram & h, char * title );
 };
 #endif
 #endif
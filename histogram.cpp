@@ -0,0 +1,171 @@
+#include "histogram.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+histogram::histogram( unsigned int nbins, double lower, double upper, bool overflow ) {
+  this->bin.resize(nbins > 0 ? nbins : 1);
+  this->overflow = overflow;
+  this->range(lower, upper);
+  return;
+}
+
+/*-- New limits, which also empties the bins --*/
+void histogram::range( double lower, double upper ) {
+  if ( !(upper > lower) )
+    upper = lower + 1.0;
+  this->lower = lower;
+  this->width = (upper - lower)/this->bin.size();
+  this->scale = 1.0/this->width;
+  this->reset();
+  return;
+}
+
+void histogram::reset( void ) {
+  memset(&this->bin[0], 0, this->bin.size()*sizeof(double));
+  this->total = 0;
+  this->missed = 0;
+  return;
+}
+
+void histogram::add( double x ) {
+
+  double f = (x - this->lower)*this->scale;
+  long last = this->bin.size() - 1;
+  long i;
+
+  this->total++;
+
+  if ( f >= 0.0 && f < last + 1 )
+    i = (long)f;
+  else if ( this->overflow && f < 0.0 )
+    i = 0;
+  else if ( this->overflow && f >= last + 1 )
+    i = last;
+  else {
+    this->missed++;               // out of range, or NaN
+    return;
+  }
+
+  this->bin[i]++;
+  return;
+}
+
+typedef struct {
+  histogram *h;
+  const double *x;
+  size_t n;
+} histogram_slice;
+
+void *histogram::partial( void *arg ) {
+  histogram_slice *s = (histogram_slice *)arg;
+  for ( size_t i=0; i<s->n; i++ )
+    s->h->add(s->x[i]);
+  return NULL;
+}
+
+/*
+ * The helpers, shared by every histogram: slice t of each round goes to
+ * helper t, slice 0 to whoever called add(). One threaded add() at a
+ * time, so a round is over before the next one is set up.
+ */
+static pthread_mutex_t add_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t work_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t work_done = PTHREAD_COND_INITIALIZER;
+static vector<histogram_slice> work;    // this round's slices, under work_lock
+static unsigned long work_round;
+static unsigned int work_pending;       // helpers' slices not done yet
+static unsigned int helpers;            // started so far, under add_lock
+
+void *histogram::helper( void *arg ) {
+  unsigned int t = (unsigned int)(uintptr_t)arg;
+  unsigned long seen = 0;
+
+  pthread_mutex_lock(&work_lock);
+  while ( true ) {
+    while ( seen == work_round )
+      pthread_cond_wait(&work_ready, &work_lock);
+    seen = work_round;
+
+    if ( t < work.size() ) {
+      histogram_slice *s = &work[t];
+      pthread_mutex_unlock(&work_lock);
+      histogram::partial(s);
+      pthread_mutex_lock(&work_lock);
+      if ( --work_pending == 0 )
+	pthread_cond_signal(&work_done);
+    }
+  }
+  return NULL;
+}
+
+/*-- n samples, split over up to threads threads for big arrays --*/
+void histogram::add( const double *x, size_t n, unsigned int threads ) {
+
+  if ( threads > n/HISTOGRAM_CHUNK )
+    threads = n/HISTOGRAM_CHUNK;
+
+  if ( threads <= 1 ) {
+    for ( size_t i=0; i<n; i++ )
+      this->add(x[i]);
+    return;
+  }
+
+  pthread_mutex_lock(&add_lock);
+
+  for ( ; helpers < threads-1; helpers++ ) {
+    pthread_t tid;
+    if ( pthread_create(&tid, NULL, histogram::helper, (void *)(uintptr_t)(helpers+1)) ) {
+      perror("histogram: pthread_create");
+      exit(errno);
+    }
+    pthread_detach(tid);
+  }
+
+  vector<histogram> part(threads, histogram(1, 0.0, 1.0, this->overflow));
+  size_t chunk = n/threads;
+
+  pthread_mutex_lock(&work_lock);
+  work.resize(threads);
+  for ( unsigned int t=0; t<threads; t++ ) {
+    part[t] = *this;
+    part[t].reset();
+    work[t].h = &part[t];
+    work[t].x = x + t*chunk;
+    work[t].n = ( t == threads-1 ) ? n - t*chunk : chunk;
+  }
+  work_pending = threads-1;
+  work_round++;
+  histogram_slice first = work[0];
+  pthread_cond_broadcast(&work_ready);
+  pthread_mutex_unlock(&work_lock);
+
+  // The calling thread takes the first slice itself
+  histogram::partial(&first);
+  this->merge(part[0]);
+
+  pthread_mutex_lock(&work_lock);
+  while ( work_pending )
+    pthread_cond_wait(&work_done, &work_lock);
+  pthread_mutex_unlock(&work_lock);
+
+  for ( unsigned int t=1; t<threads; t++ )
+    this->merge(part[t]);
+
+  pthread_mutex_unlock(&add_lock);
+  return;
+}
+
+/*-- Add the counts of a histogram with the same bins --*/
+void histogram::merge( const histogram &other ) {
+  for ( unsigned int i=0; i<this->bin.size(); i++ )
+    this->bin[i] += other.bin[i];
+  this->total += other.total;
+  this->missed += other.missed;
+  return;
+}
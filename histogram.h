@@ -0,0 +1,60 @@
+#ifndef __HISTOGRAM_H
+#define __HISTOGRAM_H
+
+#include <stddef.h>
+#include <vector>
+
+using namespace std;
+
+/*-- Below this many samples per thread it isn't worth starting threads --*/
+#define HISTOGRAM_CHUNK  65536
+
+/*
+ * Evenly spaced bins over [lower, upper). A sample lands in its bin by
+ * arithmetic, so filling is O(n) however many bins there are. With
+ * overflow set, samples outside the range are counted in the first or
+ * last bin, otherwise they are counted in outside() and nothing else.
+ * NaNs are always outside.
+ *
+ * Large arrays can be split across threads, each filling a partial
+ * histogram of its own that is merged at the end. The helper threads are
+ * started by the first add() that wants them and wait for the next one
+ * after that. Nothing here knows about fitness, so the same class does
+ * gene distributions.
+ */
+class histogram {
+
+ public:
+  histogram( unsigned int, double, double, bool = false );
+
+  void range( double, double );
+  void reset( void );
+
+  void add( double );
+  void add( const double *, size_t, unsigned int = 1 );
+  void merge( const histogram & );
+
+  unsigned int size( void ) { return this->bin.size(); }
+  double lower_edge( unsigned int i ) { return this->lower + i*this->width; }
+  double count( unsigned int i ) { return this->bin[i]; }
+  double *counts( void ) { return &this->bin[0]; }
+  unsigned long entries( void ) { return this->total; }
+  unsigned long outside( void ) { return this->missed; }
+
+ protected:
+
+ private:
+  static void *partial( void * );
+  static void *helper( void * );
+
+  vector<double> bin;
+  double lower;
+  double width;
+  double scale;                     // bins per unit, 1/width
+  bool overflow;
+
+  unsigned long total;
+  unsigned long missed;
+};
+
+#endif
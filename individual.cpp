@@ -1,22 +1,41 @@
 #include "individual.h"
+#include "genome.h"
+#include "log.h"
 #include <fitness.h>
 
 extern char state[256];
 
+/*-- Objectives start out unknown (NaN) until the fitness library fills them in --*/
+static float *new_objectives( void ) {
+  if ( params->OBJECTIVES <= 0 )
+    return NULL;
+
+  float *objective = new float [params->OBJECTIVES];
+  for ( int i=0; i<params->OBJECTIVES; i++ )
+    objective[i] = numeric_limits<float>::quiet_NaN();
+  return objective;
+}
+
 /*-- Default instantiator, mostly for creating temporary individuals --*/
 individual::individual( void ) {
 
   this->nGenes = params->NUMBER_OF_GENES;
 
-  this->gene = new float [this->nGenes];
+  this->gene = new gene_t [this->nGenes];
   if ( this->gene == NULL )
     exit(2);
 
   for (int i=0; i<this->nGenes; i++)
-    this->gene[i] = 0.0f;
+    this->gene[i] = 0;
 
   this->fitness = this->max_fitness = params->MAX_FITNESS;
   this->accuracy = params->ACCURACY;
+  this->mutation_rate = params->MUTATION_RATE;
+  this->objective = new_objectives();
+  this->cutoff = INFINITY;
+  this->bounded = false;
+  this->estimated = false;
+  this->owns_genes = true;
   this->count = -1;
   this->generation = 0;
   this->previous = NULL;
@@ -30,21 +49,27 @@ individual::individual( individual **new_person, bool initialize , bool FIRST )
 
   this->nGenes = params->NUMBER_OF_GENES;
 
-  this->gene = new float [this->nGenes];
+  this->gene = new gene_t [this->nGenes];
   if ( this->gene == NULL )
     exit(3);
 
   this->max_fitness = params->MAX_FITNESS;
   this->accuracy    = params->ACCURACY;
+  this->mutation_rate = params->MUTATION_RATE;
+  this->objective = new_objectives();
+  this->cutoff = INFINITY;
+  this->bounded = false;
+  this->estimated = false;
+  this->owns_genes  = true;
 
   if ( initialize ) {
     for (int i=0; i<this->nGenes; i++)
-      this->gene[i] = params->pLO[i] + randf()*(params->pHI[i] - params->pLO[i]);
+      this->gene[i] = gene_store(params->pLO[i] + randf()*(params->pHI[i] - params->pLO[i]));
     this->testFitness();
   }
   else {
     for (int i=0; i<this->nGenes; i++)
-      this->gene[i] = 0.0f;
+      this->gene[i] = 0;
     this->fitness = params->MAX_FITNESS;
   }
 
@@ -65,9 +90,44 @@ individual::individual( individual **new_person, bool initialize , bool FIRST )
   return;
 }
 
+/*-- Instantiator for individuals whose genes live somewhere else (e.g. a mapped popfile) --*/
+individual::individual( individual **new_person, gene_t *genes, float fitness, bool FIRST ) {
+
+  this->nGenes      = params->NUMBER_OF_GENES;
+  this->gene        = genes;
+  this->owns_genes  = false;
+  this->fitness     = fitness;
+  this->mutation_rate = params->MUTATION_RATE;
+  this->objective = new_objectives();
+  this->cutoff = INFINITY;
+  this->bounded = false;
+  this->estimated = false;
+  this->max_fitness = params->MAX_FITNESS;
+  this->accuracy    = params->ACCURACY;
+
+  this->previous    = 0x0;
+  this->next        = 0x0;
+  this->count       = 0;
+  this->generation  = 0;
+
+  if ( FIRST ) {
+    this->count = 1;
+  } else if ( *new_person ) {
+    (*new_person)->next = this;
+    this->previous = *new_person;
+    this->count = (*new_person)->count + 1;
+  }
+
+  *new_person = this;
+  return;
+}
+
 /*-- Default destructor --*/
 individual::~individual( void ) {
-  delete [] gene;
+  if ( this->owns_genes )
+    delete [] gene;
+  if ( this->objective )
+    delete [] this->objective;
   this->next = 0x0;
   this->previous = 0x0;
   this->count = 0;
@@ -80,7 +140,7 @@ individual::~individual( void ) {
 /* Create a new set of genes for this individual */
 void individual::set_genes( void ) {
   for (int i=0; i<this->nGenes; i++)
-    this->gene[i] = params->pLO[i] + randf()*(params->pHI[i] - params->pLO[i]);
+    this->gene[i] = gene_store(params->pLO[i] + randf()*(params->pHI[i] - params->pLO[i]));
   this->testFitness();
   return;
 }
@@ -89,10 +149,7 @@ bool individual::isClone( individual * person ) {
   if ( this->fitness != person->fitness )
     return false;
 
-  bool clone = true;
-  for ( int i=0; i<this->nGenes; i++ )
-    clone = clone && (this->gene[i] == person->gene[i]);
-  return clone;
+  return genome::current()->same(this->gene, person->gene);
 }
 
 individual *individual::get_mate( int size, individual *population[] ) {
@@ -120,30 +177,19 @@ individual *individual::get_mate( int size, individual *population[] ) {
   return population[number];
 }
 
-individual *individual::make_baby( individual *mommy ) {
+individual *individual::make_baby( individual *mommy, bool evaluate, float cutoff ) {
   static individual *baby = new individual();
 
-  for (int i=0; i<this->nGenes; i+=2) {
-
-    if (randf() > 0.50f) {
-      baby->gene[i] = this->gene[i];
-
-      if ( i+1 < this->nGenes )
-	baby->gene[i+1] = mommy->gene[i+1];
-
-    } else {
-      baby->gene[i] = mommy->gene[i];
-
-      if ( i+1 < this->nGenes )
-	baby->gene[i+1] = this->gene[i+1];
-
-    }
-  }
+  genome::current()->crossover(this->gene, mommy->gene, baby->gene);
 
   baby->generation = 0;
+  baby->mutation_rate = genome::adapt(this->mutation_rate, mommy->mutation_rate);
+
+  // How much worse than the cutoff it is doesn't matter to whoever asked for it
+  baby->cutoff = cutoff;
   
   baby->mutate();
-  if ( !params->NUM_THREADS )  
+  if ( evaluate && !params->ASYNC_FITNESS )
     baby->testFitness();
 
   return baby;
@@ -159,19 +205,13 @@ void individual::mutate_simple( void ) {
 
   /* 
    * Toss a random number in [0,1].... as long as this number
-   * is less than params->MUTATION_RATE, randomly select
+   * is less than this individual's mutation rate, randomly select
    * one gene to mutate by replacement. Slightly better than
    * brute force testing each gene for mutation.
    */
-  int counter = 1;
-  while ( randf() < params->MUTATION_RATE ) {   // Are we going to mutate?
-    // Yuppers.... select an integer in [0,this->nGenes-1]
-    unsigned int which = rand() %  this->nGenes;
-    this->gene[which] = params->pLO[which] + randf()*(params->pHI[which] - params->pLO[which]);
-    counter++;
-  }
+  genome::current()->mutate(this->gene, this->mutation_rate);
 
-  this->testFitness();
+  // Evaluating is up to the caller, as it is after a bitflip mutation
   return;
 }
 
@@ -182,7 +222,7 @@ void individual::mutate( void ) {
    * Nothing is going to happen anyhow, so don't
    * waste the CPU cycles for no result.
    */
-  if ( params->MUTATION_RATE <= 0.0f )
+  if ( this->mutation_rate <= 0.0f )
     return;
 
   /*-- If a simple mutation scheme was called for, call it here and bail --*/
@@ -191,72 +231,14 @@ void individual::mutate( void ) {
     return;
   }
 
-  /* We need to iterate over the bits in the parameters structure
-   * this will be a pointer to those bits since floats don't go
-   * into bitwise operators nicely. unsignend longs are 32 bits,
-   * same as floats, so this matches each of the parameters in
-   * struct parameters
-   */
-  unsigned int *fltPointer;
-
-  /*-- Save the original parameter, in case the mutation is really bad --*/
-  float saveParam;
-  bool stillborn = false;
-
-  /* this is the number of bits that we'll look at in the parameter
-   * structure. (sizeof returns bytes, not bits, hence the 8 bits/byte 
-   * conversion factor)
-   */ 
-  const unsigned long int number_of_bits = 8*sizeof( typeof(this->gene[0]) );
-
-  /* This yields a cummulative probability that 
-   * 1 or more bits will get flipped in the routine
-   */
-  static float probability_per_bit = params->MUTATION_RATE/((float)number_of_bits);
-  static float probability_per_gene = params->MUTATION_RATE/((float)this->nGenes);
-  unsigned short int i;
-
-  /* Randomly flip bits with some cummulative probability.
-   * According to IEEE Standard 754,  a single precision 
-   * floating point number is represented as ... 
+  /* Randomly flip bits with some cummulative probability, see
+   * bitflip_mutation in genome.h. According to IEEE Standard 754, a
+   * single precision floating point number is represented as ...
    * bit 31 = sign, bits 30 - 23 = exponent, bits 22 - 0 = 
    * fraction with an exponent bias of 127 (Little Endian).
    */
   errno = 0;
-  for (i=0; i<this->nGenes; i++) {
-
-    // One test to see if something is getting flipped
-    if ( randf() < probability_per_gene ) {
-
-      // So at least one is getting changed....
-      unsigned short int which = (unsigned short int)(randf()*number_of_bits);
-
-      /*-- Cast the memory location of the first variable to an unsigned long --*/
-      fltPointer = (unsigned int *)&this->gene[i];
-      saveParam = this->gene[i];
-      
-      // Flip the bit
-      *fltPointer ^= (1<<which); 
-
-      // Take a shot at flipping the others
-      while ( randf() < probability_per_bit ) {
-	which = (unsigned short int)randf()*number_of_bits;
-	*fltPointer ^= (1<<which); 
-      }
-
-      // Check for errors induced in the bit flipping
-      stillborn = this->gene[i] != this->gene[i] ||
-	fabs(this->gene[i]) == INFINITY ||
-	this->gene[i] < params->pLO[i] || this->gene[i] > params->pHI[i];
-
-      if ( stillborn ) {
-	this->gene[i] = saveParam;
-	i--;
-      }
-
-    } // End of if ( randf() < params->MUTATION_RATE )
-
-  } // End of for (i=0; i<this->nGenes; i++)
+  genome::current()->mutate(this->gene, this->mutation_rate);
 
   if ( errno ) {
     printf("Error %i in ", errno);
@@ -270,10 +252,16 @@ void individual::mutate( void ) {
 /*-- Make a complete copy of person, excluding the links -*/
 void individual::copy( individual *person, bool deep ) {
 
-  *this->gene = {0.0f};
-  memcpy( this->gene, person->gene, this->nGenes*sizeof(float) );
+  memcpy( this->gene, person->gene, this->nGenes*sizeof(gene_t) );
+
+  if ( this->objective && person->objective )
+    memcpy( this->objective, person->objective, params->OBJECTIVES*sizeof(float) );
 
   this->fitness = person->fitness;
+  this->bounded = person->bounded;
+  this->estimated = person->estimated;
+  this->cutoff = person->cutoff;
+  this->mutation_rate = person->mutation_rate;
   this->generation = person->generation;
 
     if ( deep ) {
@@ -293,22 +281,29 @@ void individual::copy( individual *person, bool deep ) {
 
 void individual::output(bool newline) {
 
-  printf("%i %0.*f ( ", this->count, this->accuracy, this->fitness);
-  for ( int i=0; i<this->nGenes; i++ )
-    printf("%+0.*f, ", this->accuracy, this->gene[i]);
-  printf("\b\b )\n");
-
-  if ( this->previous )
-    printf(" following %i",this->previous->count);
-  else
-    printf(" first ");
-  if ( this->next )
-    printf(" leading %i", this->next->count);
-  else
-    printf(" last");
+  log_int(this->count);
+  log_char(' ');
+  log_fixed(this->fitness, this->accuracy);
+  log_str(" ( ");
+  for ( int i=0; i<this->nGenes; i++ ) {
+    log_fixed((double)gene_value(this->gene[i]), this->accuracy, true);
+    log_str(", ");
+  }
+  log_str("\b\b )\n");
+
+  if ( this->previous ) {
+    log_str(" following ");
+    log_int(this->previous->count);
+  } else
+    log_str(" first ");
+  if ( this->next ) {
+    log_str(" leading ");
+    log_int(this->next->count);
+  } else
+    log_str(" last");
 
   if ( newline )
-    printf("\n");
+    log_char('\n');
 
 
   return;
@@ -16,6 +16,7 @@ class individual {
  public:
   individual( void );
   individual( individual **, bool=true, bool=false );
+  individual( individual **, gene_t *, float, bool=false );
   ~individual( void );
 
   void testFitness( void );
@@ -26,17 +27,23 @@ class individual {
   void output( bool=false );
   bool isClone( individual * );
 
-  individual *make_baby(individual *);
+  individual *make_baby(individual *, bool=true, float=INFINITY);
   individual *get_mate( int, individual ** );
 
   int count;
   int nGenes;
   float fitness;
-  float *gene;
+  float mutation_rate;              // self-adapted, see genome::adapt()
+  float *objective;                 // OBJECTIVES of them for multi-objective runs, else NULL
+  float cutoff;                     // the fitness function may stop once it's sure to be worse than this,
+  bool bounded;                     // in which case it sets this and fitness is only a lower bound
+  bool estimated;                   // fitness is the surrogate's prediction, it was never evaluated
+  gene_t *gene;
   int progeny;
   int generation;
   float max_fitness;
   int accuracy;
+  bool owns_genes;
 
   individual *previous;
   individual *next;
@@ -0,0 +1,296 @@
+#include "log.h"
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+
+logger *console = NULL;
+
+typedef struct {
+  size_t used;
+  char data[LOG_BUFFER];
+} log_buffer;
+
+static __thread log_buffer *local = NULL;
+
+/*-- Each thread's buffer is registered under a key, so whatever is left in it goes out when the thread does --*/
+static pthread_key_t buffer_key;
+static pthread_once_t buffer_once = PTHREAD_ONCE_INIT;
+
+static void write_out( const char *text, size_t n ) {
+  if ( console )
+    console->submit(text, n);
+  else {
+    fwrite(text, 1, n, stdout);
+    fflush(stdout);
+  }
+  return;
+}
+
+static void release( void *p ) {
+  log_buffer *b = (log_buffer *)p;
+  if ( b->used )
+    write_out(b->data, b->used);
+  delete b;
+  local = NULL;
+  return;
+}
+
+static void make_key( void ) {
+  pthread_key_create(&buffer_key, release);
+  return;
+}
+
+static inline log_buffer *buffer( void ) {
+  if ( !local ) {
+    local = new log_buffer;
+    local->used = 0;
+    pthread_once(&buffer_once, make_key);
+    pthread_setspecific(buffer_key, local);
+  }
+  return local;
+}
+
+/*-- Room for n more bytes, flushing first if there isn't --*/
+static inline char *reserve( size_t n ) {
+  log_buffer *b = buffer();
+  if ( b->used + n > LOG_BUFFER )
+    log_flush();
+  return b->data + b->used;
+}
+
+void log_str( const char *s ) {
+  size_t n = strlen(s);
+  if ( n > LOG_BUFFER/2 ) {
+    log_flush();
+    write_out(s, n);
+    return;
+  }
+  memcpy(reserve(n), s, n);
+  local->used += n;
+  return;
+}
+
+void log_char( char c ) {
+  *reserve(1) = c;
+  local->used++;
+  return;
+}
+
+void log_printf( const char *format, ... ) {
+  va_list ap;
+
+  char *p = reserve(512);
+  va_start(ap, format);
+  int n = vsnprintf(p, LOG_BUFFER - local->used, format, ap);
+  va_end(ap);
+
+  // Longer than what was left: flush and try once more in a whole buffer
+  if ( n >= (int)(LOG_BUFFER - local->used) ) {
+    log_flush();
+    va_start(ap, format);
+    n = vsnprintf(local->data, LOG_BUFFER, format, ap);
+    va_end(ap);
+    if ( n >= LOG_BUFFER )
+      n = LOG_BUFFER - 1;
+  }
+  if ( n > 0 )
+    local->used += n;
+  return;
+}
+
+/*-- Digits of v, most significant first, into p; returns how many --*/
+static inline int digits( uint64_t v, char *p, int width ) {
+  char tmp[24];
+  int n = 0;
+  do {
+    tmp[n++] = '0' + v % 10;
+    v /= 10;
+  } while ( v );
+  while ( n < width )
+    tmp[n++] = '0';
+  for ( int i=0; i<n; i++ )
+    p[i] = tmp[n-1-i];
+  return n;
+}
+
+void log_int( long v, int width ) {
+  char *p = reserve(48);
+  int n = 0;
+  if ( v < 0 ) {
+    p[n++] = '-';
+    n += digits(-(uint64_t)v, p+n, width > 1 ? width-1 : 0);
+  } else
+    n += digits(v, p+n, width);
+  local->used += n;
+  return;
+}
+
+static const double tens[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+
+/*-- %.*f (or %+.*f) for the common case, printf for the rest --*/
+void log_fixed( double v, int places, bool sign ) {
+
+  if ( places < 0 || places > 9 ) {
+    log_printf(sign ? "%+.*f" : "%.*f", places, v);
+    return;
+  }
+
+  // Too big, not a number, or so close to half way that the product's own
+  // rounding could tip it the wrong way: leave those to printf
+  double product = __builtin_fabs(v)*tens[places];
+  double tie = product - __builtin_floor(product) - 0.5;
+  if ( !(product < 1e15) || __builtin_fabs(tie) <= product*1e-15 ) {
+    log_printf(sign ? "%+.*f" : "%.*f", places, v);
+    return;
+  }
+
+  char *p = reserve(48);
+  int n = 0;
+
+  bool negative = __builtin_signbit(v);
+  if ( negative )
+    p[n++] = '-';
+  else if ( sign )
+    p[n++] = '+';
+
+  uint64_t scaled = (uint64_t)__builtin_rint(product);
+  uint64_t unit = (uint64_t)tens[places];
+
+  n += digits(scaled/unit, p+n, 0);
+  if ( places ) {
+    p[n++] = '.';
+    n += digits(scaled % unit, p+n, places);
+  }
+
+  local->used += n;
+  return;
+}
+
+/*-- Hand this thread's text to the writer (or straight to stdout without one) --*/
+void log_flush( void ) {
+  log_buffer *b = buffer();
+  if ( !b->used )
+    return;
+
+  write_out(b->data, b->used);
+  b->used = 0;
+  return;
+}
+
+/*-- Flush, and wait until everything handed over so far is out --*/
+void log_sync( void ) {
+  log_flush();
+  if ( console )
+    console->sync();
+  return;
+}
+
+/*-- At most LOG_STATUS_HZ status lines a second; one answer per tick --*/
+bool log_status_due( unsigned int tick ) {
+  static unsigned int last_tick = 0;
+  static bool due = true;
+  static uint64_t last = 0;
+
+  if ( tick == last_tick )
+    return due;
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  uint64_t now = (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+
+  last_tick = tick;
+  due = ( now - last >= 1000000000ull/LOG_STATUS_HZ );
+  if ( due )
+    last = now;
+  return due;
+}
+
+logger::logger( FILE *out ) {
+
+  this->out = out;
+  this->writing = false;
+  this->stopping = false;
+  this->pending.reserve(LOG_BUFFER);
+
+  pthread_mutex_init(&this->lock, NULL);
+  pthread_cond_init(&this->ready, NULL);
+  pthread_cond_init(&this->drained, NULL);
+
+  if ( pthread_create(&this->tid, NULL, logger::writer, this) ) {
+    perror("logger: pthread_create");
+    exit(errno);
+  }
+  return;
+}
+
+logger::~logger( void ) {
+
+  log_flush();
+
+  pthread_mutex_lock(&this->lock);
+  this->stopping = true;
+  pthread_cond_signal(&this->ready);
+  pthread_mutex_unlock(&this->lock);
+  pthread_join(this->tid, NULL);
+
+  // Threads that finish after this write their leftovers to stdout themselves
+  if ( console == this )
+    console = NULL;
+
+  pthread_cond_destroy(&this->drained);
+  pthread_cond_destroy(&this->ready);
+  pthread_mutex_destroy(&this->lock);
+  return;
+}
+
+/*-- Queue n bytes; only waits if the terminal is LOG_BACKLOG behind --*/
+void logger::submit( const char *text, size_t n ) {
+  pthread_mutex_lock(&this->lock);
+  while ( this->pending.size() > LOG_BACKLOG )
+    pthread_cond_wait(&this->drained, &this->lock);
+  this->pending.insert(this->pending.end(), text, text + n);
+  pthread_cond_signal(&this->ready);
+  pthread_mutex_unlock(&this->lock);
+  return;
+}
+
+void logger::sync( void ) {
+  pthread_mutex_lock(&this->lock);
+  while ( this->pending.size() || this->writing )
+    pthread_cond_wait(&this->drained, &this->lock);
+  pthread_mutex_unlock(&this->lock);
+  return;
+}
+
+void *logger::writer( void *arg ) {
+  logger *self = (logger *)arg;
+  vector<char> out;
+
+  pthread_mutex_lock(&self->lock);
+  while ( true ) {
+    while ( self->pending.empty() && !self->stopping )
+      pthread_cond_wait(&self->ready, &self->lock);
+    if ( self->pending.empty() )
+      break;
+
+    out.swap(self->pending);
+    self->writing = true;
+    pthread_cond_broadcast(&self->drained);
+    pthread_mutex_unlock(&self->lock);
+
+    fwrite(&out[0], 1, out.size(), self->out);
+    fflush(self->out);
+    out.clear();
+
+    pthread_mutex_lock(&self->lock);
+    self->writing = false;
+    pthread_cond_broadcast(&self->drained);
+  }
+  pthread_mutex_unlock(&self->lock);
+
+  return NULL;
+}
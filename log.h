@@ -0,0 +1,66 @@
+#ifndef __LOG_H
+#define __LOG_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include <vector>
+
+using namespace std;
+
+#define LOG_BUFFER     65536        // per thread, handed to the writer when full
+#define LOG_BACKLOG    (8 << 20)    // bytes the writer may fall behind before callers wait
+#define LOG_STATUS_HZ  10           // status lines per second, at most
+
+/*
+ * Console output without the generation loop waiting on the terminal.
+ * Text is formatted into a buffer belonging to the calling thread, with
+ * no locks; log_flush() hands the buffer to a background writer, which
+ * is the only thing that touches stdout. Numbers go through log_int()
+ * and log_fixed(), which print the same digits as %i and %.*f without
+ * going through printf, log_printf() is there for anything else. A
+ * thread's buffer is flushed and freed when the thread exits.
+ *
+ * Without a writer (console is NULL, as in ga_worker and ga_bench)
+ * log_flush() writes to stdout itself. Before printing to stdout some
+ * other way, or reading stdin, call log_sync().
+ */
+void log_printf( const char *, ... );
+void log_str( const char * );
+void log_char( char );
+void log_int( long, int = 0 );             // zero padded to width
+void log_fixed( double, int, bool = false ); // digits after the point, always signed?
+
+void log_flush( void );
+void log_sync( void );
+bool log_status_due( unsigned int );
+
+class logger {
+
+ public:
+  logger( FILE * );
+  ~logger( void );
+
+  void submit( const char *, size_t );
+  void sync( void );
+
+ protected:
+
+ private:
+  static void *writer( void * );
+
+  FILE *out;
+  vector<char> pending;
+  bool writing;
+  bool stopping;
+
+  pthread_t tid;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  pthread_cond_t drained;
+};
+
+extern logger *console;
+
+#endif
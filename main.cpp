@@ -1,7 +1,13 @@
 #include "global.h"
 #include "population.h"
 #include "individual.h"
-#include "gnuplot.h"
+#include "plotter.h"
+#include "metrics.h"
+#include "steady.h"
+#include "optimizer.h"
+#include "checkpoint.h"
+#include "popfile.h"
+#include "genome.h"
 #include <fitness.h>
 
 #include <signal.h>
@@ -34,14 +40,9 @@ static void sig_stop(int sig_number) {
 
 int main( int argc, char** argv ) {
 
-  struct timeval tv1, tv2;
-  unsigned int elapsed_time = 0;
-
-  GnuPlot *gplot = new GnuPlot();
-  double * fitness_array;
-
-  const unsigned int nbins = 100;
-  double * ordinate = new double[nbins];
+  double elapsed_time = 0.0;
+  uint64_t started = 0;
+  unsigned int first_generation = 0;
 
   /*-- Instantiate the requisite classes --*/
   params = new parameters( (char *)"ga.rcp" );
@@ -49,24 +50,112 @@ int main( int argc, char** argv ) {
   // Initialize the random number generator
   randomize();
 
+  // Fixed point genes need their step size, and limits that land on steps
+  gene_setup();
+
+  // Pick the crossover and mutation kernels compiled for this many genes
+  genome::select(params->NUMBER_OF_GENES, params->MUTATE_SIMPLE);
+
+  // Terminal output goes through a writer thread, so a slow terminal can't slow evolution
+  console = new logger( stdout );
+
+  // Break each generation down by phase?
+  if ( params->PHASE_TIMING > 0 )
+    timing = new phase_timer( params->PHASE_TIMING, params->PHASE_FILE );
+
+  // Hardware counters too? They have to be open before the thread pool starts
+  if ( params->PERF_COUNTERS > 0 ) {
+    counters = new perf_counters( params->PERF_COUNTERS, params->PERF_FILE );
+    if ( !counters->usable() ) {
+      delete counters;
+      counters = NULL;
+    }
+  }
+
+  // Record a timeline? Threads started from here on get their own tracks
+  if ( params->TRACE_FILE && *params->TRACE_FILE ) {
+    tracer *t = new tracer( params->TRACE_FILE );
+    t->name_thread("main");
+    trace.store(t, memory_order_release);
+  }
+
+  // Steady state workers evaluate their own children, there's nothing to farm out
+  if ( params->STEADY_STATE && params->WORKERS && *params->WORKERS ) {
+    fprintf(stderr, "STEADY_STATE evaluates fitness in its own threads and can't be used with WORKERS\n");
+    exit(EINVAL);
+  }
+  if ( params->STEADY_STATE && params->OPTIMIZER != "GA" ) {
+    fprintf(stderr, "STEADY_STATE is a GA mode, OPTIMIZER %s can't be used with it\n", params->OPTIMIZER.c_str());
+    exit(EINVAL);
+  }
+  if ( params->SURROGATE && (params->STEADY_STATE || params->OPTIMIZER != "GA") ) {
+    fprintf(stderr, "SURROGATE screens the generational GA's children, it can't be used with STEADY_STATE or another OPTIMIZER\n");
+    exit(EINVAL);
+  }
+
   // Initialize the function mapping for the fitness library
   initialize_fitness_library();
 
+  if ( (params->OPTIMIZER == "NSGA2" || params->OPTIMIZER == "NSGA-II") && !fitness_objectives() ) {
+    fprintf(stderr, "NSGA-II needs a fitness function that fills in objectives: a FITNESS_PLUGIN "
+	    "with GA_PLUGIN_OBJECTIVES, the built in ones have a single fitness\n");
+    exit(EINVAL);
+  }
+
+  // Pick up where a previous run left off, if asked and if there's anything to pick up
+  checkpoint *snapshot = NULL;
+  if ( params->CHECKPOINT_FILE && *params->CHECKPOINT_FILE )
+    snapshot = new checkpoint( params->CHECKPOINT_FILE );
+
+  bool resuming = snapshot && params->RESUME && !access(params->CHECKPOINT_FILE, R_OK);
+
+  // Seed the population from a population file instead of at random?
+  popfile *seed = NULL;
+  if ( !resuming && params->SEED_POPULATION && *params->SEED_POPULATION )
+    seed = new popfile( params->SEED_POPULATION );
+
   // Create a new population of params->INITIAL_POPULATION individuals
-  population *society = new population();
+  population *society;
+  if ( resuming )
+    society = new population( false );
+  else if ( seed )
+    society = new population( seed );
+  else
+    society = new population();
+
+  if ( resuming && !snapshot->load(society) ) {
+    fprintf(stderr, "Unable to resume from %s\n", params->CHECKPOINT_FILE);
+    exit(EINVAL);
+  }
 
   /*-- Since this is a CPU intensive process, renice it to low priority --*/
   setpriority( PRIO_PROCESS, 0, renice_priority );
 
-  if ( params->VERBOSE == 2 )
-    gettimeofday(&tv1, NULL);
+  // Live plots come from a thread of their own, so gnuplot never holds up a generation
+  plotter *plot = params->SHOW_PLOT ? new plotter() : NULL;
 
-  char range[128];
+  // Headless runs can be watched through a metrics file or port instead
+  if ( (params->METRICS_FILE && *params->METRICS_FILE) || params->METRICS_PORT > 0 )
+    monitor = new metrics( params->METRICS_FILE, params->METRICS_PORT, params->METRICS_INTERVAL );
+
+  // Or no generations at all: workers breed and replace in place, and main keeps score
+  steady_state *steady = params->STEADY_STATE ? new steady_state( society, params->NUM_THREADS ) : NULL;
+
+  // Or something other than a GA altogether
+  optimizer *engine = optimizer::select( society );
+
+  started = phase_now();
+  first_generation = society->generation;
 
   while (!STOPNOW) {
 
     /*-- Start the mating dance (it must be springtime!) --*/
-    society->mate();
+    if ( steady )
+      steady->advance();
+    else if ( engine )
+      engine->step();
+    else
+      society->mate();
 
     /*-- Allow a clean exit on <CTRL>-C (SIGINT) --*/
     if(signal(SIGINT, sig_stop) == SIG_ERR)
@@ -74,72 +163,123 @@ int main( int argc, char** argv ) {
 
     // Dump out the population status
     society->print();
-
-    if ( params->VERBOSE == 2 ) {
-      if ( elapsed_time > 0 )
-	printf("Gen/s = %.0f     \r", (double)(society->generation/elapsed_time));
-      else
-	printf("Gen/s = x.xx     \r");
+    if ( monitor )
+      monitor->publish(society);
+
+    if ( params->VERBOSE == 2 && log_status_due(society->generation) ) {
+      if ( elapsed_time > 0.0 ) {
+	log_str("Gen/s = ");
+	log_fixed((society->generation - first_generation)/elapsed_time, 1);
+	log_str("     \r");
+      } else
+	log_str("Gen/s = x.xx     \r");
     }
 
-    // pop a plot into a gnuplot window
-    if ( params->SHOW_PLOT && !(society->generation % params->PLOT_FREQ) ) {
-      gplot->gnuplot_resetplot();
+    bool plotting = plot && !(society->generation % params->PLOT_FREQ);
+    bool saving = snapshot && params->CHECKPOINT_FREQ > 0 && !(society->generation % params->CHECKPOINT_FREQ);
 
-      float avg = society->average;
-      float stdev = society->stdev;
+    // Both read the whole population, which steady state workers have to leave alone meanwhile
+    if ( steady && (plotting || saving) )
+      steady->pause();
 
-      sprintf(range, "set xrange [%f:%f];set yrange[0:50]", 
-	      params->EXIT_LIMIT, avg+stdev);
-      gplot->gnuplot_cmd(range);
+    // pop a plot into a gnuplot window, drawn by the plotting thread
+    if ( plotting )
+      plot->submit(society);
 
-      float plot_max = avg + 2*stdev;
-      if ( plot_max < 0.25 )
-	plot_max = 0.25;
-      for ( unsigned int i=0; i<nbins; i++ )
-	ordinate[i] = i*plot_max/nbins;
+    // Save the state of play every so often, without waiting for the disk
+    if ( saving )
+      snapshot->save(society);
 
-      fitness_array = society->get_population_fitness();
-      gplot->gnuplot_plot_histogram( ordinate, fitness_array, nbins, 0, (char *)"Population Fitness");
-    }
+    if ( steady && (plotting || saving) )
+      steady->resume();
 
     // Take a little siesta to reduce CPU consumption
     if ( params->CPU_USAGE_LIMIT < 100 )
       naptime(society->generation);
 
+    // Whatever this generation had to say goes to the writer thread in one piece
+    log_flush();
+
     STOPNOW = 
       STOPNOW || 
       society->mostfit->fitness <= params->EXIT_LIMIT || 
       (params->MAXIMUM_GENERATIONS > 0 && 
        (int)society->generation >= params->MAXIMUM_GENERATIONS);
 
-    if ( params->VERBOSE == 2 ) {
-      gettimeofday(&tv2, NULL);
-      elapsed_time = (tv2.tv_sec - tv1.tv_sec);
-    }
+    elapsed_time = 1e-9*(phase_now() - started);
   } // End while (!STOPNOW)
 
-  // Dump out the results
-  printf("\n\nGeneration %i Most fit = %0.*f\n",
-	 society->generation, params->ACCURACY, society->mostfit->fitness);
+  if ( steady )
+    steady->stop();
+  if ( engine )
+    engine->finish();
+
+  // One last checkpoint, and make sure it's on disk before we go
+  if ( snapshot ) {
+    snapshot->wait();
+    snapshot->save(society);
+    delete snapshot;
+  }
+
+  // Dump out the results; the fitness library prints for itself, so catch up first
+  log_printf("\n\nGeneration %i Most fit = %0.*f\n",
+	     society->generation, params->ACCURACY, society->mostfit->fitness);
+  log_sync();
 
   outputIndividual(society->mostfit);
+  fflush(stdout);
+
+  if ( society->screen )
+    society->screen->report();
 
-  // And the top N individuals
-  if ( params->DUMP_N_TOP > 0 )
+  // And the top N individuals, or whatever the optimizer would rather show
+  if ( !(engine && engine->dump()) && params->DUMP_N_TOP > 0 )
     society->dump(params->DUMP_N_TOP);
 
-  if ( params->SHOW_PLOT ) {
+  // Keep the whole population around for the next run
+  if ( params->EXPORT_POPULATION && *params->EXPORT_POPULATION )
+    popfile::write(params->EXPORT_POPULATION, society);
+
+  if ( plot ) {
+    plot->finish();
+
     char temp;
-    printf("Hit <RET> to finish: ");
+    log_str("Hit <RET> to finish: ");
+    log_sync();
     temp = getc(stdin);
     temp++;
   }
 
+  if ( timing ) {
+    timing->summary(stderr);
+    delete timing;
+  }
+
+  if ( counters ) {
+    counters->summary(stderr);
+    delete counters;
+  }
+
+  /* Stop recording and write the trace out. The pool threads are never
+   * stopped and one may have loaded trace just before it was cleared, so
+   * the tracer itself is left allocated for it to finish into. */
+  tracer *t = trace.exchange(NULL);
+  if ( t )
+    t->close();
+
+  if ( steady )
+    delete steady;
+  if ( engine )
+    delete engine;
   delete society;
+  if ( seed )
+    delete seed;
+  if ( plot )
+    delete plot;
+  if ( monitor )
+    delete monitor;
+  delete console;
   delete params;
-  delete gplot;
-  delete [] ordinate;
 
   return 0;
 }
@@ -232,14 +372,17 @@ static int naptime( int counter ) {
 
     }
 
-    fflush(stdout);
-
     /*-- Pause for a breath, now & then --*/
+    uint64_t nap = trace_begin();
     usleep(sleep_time);
+    trace_end("naptime", nap, sleep_time);
   }
 
-  if ( verbose == 2 )
-    printf(" Load = %i     \r", proc_percent);
+  if ( verbose == 2 && log_status_due(counter) ) {
+    log_str(" Load = ");
+    log_int(proc_percent);
+    log_str("     \r");
+  }
 
   return proc_percent;
 } // End static void naptime()
@@ -0,0 +1,208 @@
+#include "metrics.h"
+#include "remote.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+
+metrics *monitor = NULL;
+
+metrics::metrics( const char *file, int port, double interval ) {
+
+  this->generation = 0;
+  this->size = 0;
+  this->clones = 0;
+  this->best = 0.0;
+  this->average = 0.0;
+  this->stdev = 0.0;
+  this->mutation_rate = 0.0;
+  this->screening = false;
+  this->skipped = 0;
+  this->hit_rate = 0.0;
+  this->prediction_error = 0.0;
+
+  this->last_time = remote_clock();
+  this->last_generation = 0;
+  this->last_evaluations = fitness_evaluations();
+  this->generation_rate = 0.0;
+  this->evaluation_rate = 0.0;
+
+  this->filename = ( file && *file ) ? strdup(file) : NULL;
+  this->interval = ( interval > 0.0 ) ? interval : 5.0;
+  this->stopping = false;
+  this->listener = -1;
+
+  if ( port > 0 ) {
+    char address[32];
+    snprintf(address, sizeof(address), "127.0.0.1:%i", port);
+    if ( (this->listener = remote_listen(address)) < 0 ) {
+      perror(address);
+      exit(errno);
+    }
+  }
+
+  if ( pthread_create(&this->tid, NULL, metrics::exporter, this) ) {
+    perror("metrics: pthread_create");
+    exit(errno);
+  }
+
+  return;
+}
+
+/*-- Stop the exporter and leave the final numbers in the file --*/
+metrics::~metrics( void ) {
+
+  this->stopping = true;
+  pthread_join(this->tid, NULL);
+
+  if ( this->filename ) {
+    this->write_file();
+    free(this->filename);
+  }
+  if ( this->listener >= 0 )
+    close(this->listener);
+
+  return;
+}
+
+/*-- Called by main once a generation: stores only, no locks --*/
+void metrics::publish( population *society ) {
+  this->best.store(society->mostfit->fitness, memory_order_relaxed);
+  this->average.store(society->average, memory_order_relaxed);
+  this->stdev.store(society->stdev, memory_order_relaxed);
+  this->clones.store(society->clones, memory_order_relaxed);
+  this->size.store(society->count, memory_order_relaxed);
+  this->mutation_rate.store(society->mutation_rate, memory_order_relaxed);
+  if ( society->screen ) {
+    this->skipped.store(society->screen->skipped, memory_order_relaxed);
+    this->hit_rate.store(society->screen->hit_rate(), memory_order_relaxed);
+    this->prediction_error.store(society->screen->error(), memory_order_relaxed);
+    this->screening.store(true, memory_order_relaxed);
+  }
+  this->generation.store(society->generation, memory_order_release);
+  return;
+}
+
+static void metric( string &text, const char *name, const char *type, const char *help, double value ) {
+  char line[512];
+  snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n%s %.9g\n", name, help, name, type, name, value);
+  text += line;
+  return;
+}
+
+void metrics::render( string &text ) {
+
+  unsigned int generation = this->generation.load(memory_order_acquire);
+  unsigned long evaluations = fitness_evaluations();
+
+  // Rates over the time since the last look, unless that was only a moment ago
+  double now = remote_clock();
+  if ( now - this->last_time >= 0.5 ) {
+    this->generation_rate = (generation - this->last_generation)/(now - this->last_time);
+    this->evaluation_rate = (evaluations - this->last_evaluations)/(now - this->last_time);
+    this->last_time = now;
+    this->last_generation = generation;
+    this->last_evaluations = evaluations;
+  }
+
+  text.clear();
+  metric(text, "ga_generation", "counter", "Generations completed", generation);
+  metric(text, "ga_best_fitness", "gauge", "Fitness of the fittest individual", this->best.load(memory_order_relaxed));
+  metric(text, "ga_average_fitness", "gauge", "Average fitness of the population", this->average.load(memory_order_relaxed));
+  metric(text, "ga_fitness_stdev", "gauge", "Standard deviation of the population's fitness", this->stdev.load(memory_order_relaxed));
+  metric(text, "ga_clones", "gauge", "Clones in the population", this->clones.load(memory_order_relaxed));
+  metric(text, "ga_population", "gauge", "Individuals in the population", this->size.load(memory_order_relaxed));
+  metric(text, "ga_mutation_rate", "gauge", "Average mutation rate", this->mutation_rate.load(memory_order_relaxed));
+  metric(text, "ga_generations_per_second", "gauge", "Generations per second", this->generation_rate);
+  metric(text, "ga_evaluations_total", "counter", "Fitness evaluations completed", evaluations);
+  metric(text, "ga_evaluations_per_second", "gauge", "Fitness evaluations per second", this->evaluation_rate);
+  metric(text, "ga_queue_depth", "gauge", "Fitness evaluations handed out and not finished", fitness_pending());
+  if ( this->screening.load(memory_order_relaxed) ) {
+    metric(text, "ga_surrogate_skipped_total", "counter", "Children the surrogate kept from being evaluated", this->skipped.load(memory_order_relaxed));
+    metric(text, "ga_surrogate_hit_rate", "gauge", "Fraction of children predicted to beat their fitter parent that did", this->hit_rate.load(memory_order_relaxed));
+    metric(text, "ga_surrogate_error", "gauge", "Mean absolute error of the surrogate's predictions", this->prediction_error.load(memory_order_relaxed));
+  }
+
+  return;
+}
+
+/*-- filename.tmp, then rename it over filename --*/
+void metrics::write_file( void ) {
+
+  string text;
+  this->render(text);
+
+  string temp = string(this->filename) + ".tmp";
+  FILE *f = fopen(temp.c_str(), "w");
+  if ( !f ) {
+    perror(temp.c_str());
+    return;
+  }
+
+  bool ok = fwrite(text.data(), 1, text.size(), f) == text.size();
+  ok = !fclose(f) && ok;
+
+  if ( !ok || rename(temp.c_str(), this->filename) ) {
+    perror(this->filename);
+    unlink(temp.c_str());
+  }
+  return;
+}
+
+/*-- One request, one response, then hang up; whatever was asked for gets the metrics --*/
+void metrics::answer( int fd ) {
+
+  char request[4096];
+  struct pollfd pfd = { fd, POLLIN, 0 };
+  if ( poll(&pfd, 1, 1000) > 0 )
+    recv(fd, request, sizeof(request), 0);
+
+  string text;
+  this->render(text);
+
+  char header[256];
+  int n = snprintf(header, sizeof(header),
+		   "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+		   "Content-Length: %lu\r\nConnection: close\r\n\r\n", (unsigned long)text.size());
+
+  string response = string(header, n) + text;
+  const char *p = response.data();
+  size_t left = response.size();
+  while ( left ) {
+    ssize_t bytes = send(fd, p, left, MSG_NOSIGNAL);
+    if ( bytes < 0 && errno == EINTR )
+      continue;
+    if ( bytes <= 0 )
+      break;
+    p += bytes;
+    left -= bytes;
+  }
+
+  close(fd);
+  return;
+}
+
+void *metrics::exporter( void *arg ) {
+  metrics *self = (metrics *)arg;
+  double next = remote_clock();
+
+  while ( !self->stopping ) {
+
+    if ( self->filename && remote_clock() >= next ) {
+      self->write_file();
+      next += self->interval;
+    }
+
+    // Wake up often enough to notice stopping, sooner if someone wants the metrics
+    if ( self->listener >= 0 ) {
+      struct pollfd pfd = { self->listener, POLLIN, 0 };
+      if ( poll(&pfd, 1, 100) > 0 ) {
+	int fd = accept(self->listener, NULL, NULL);
+	if ( fd >= 0 )
+	  self->answer(fd);
+      }
+    } else
+      usleep(100000);
+  }
+
+  return NULL;
+}
@@ -0,0 +1,77 @@
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include "global.h"
+#include "population.h"
+
+#include <pthread.h>
+#include <atomic>
+#include <string>
+
+using namespace std;
+
+/*-- Kept by the fitness library (fitness.cpp) while metrics are on --*/
+unsigned long fitness_evaluations( void );
+unsigned long fitness_pending( void );
+
+/*
+ * Run metrics in Prometheus' text format, for headless nodes. Once a
+ * generation main calls publish(), which is a handful of relaxed atomic
+ * stores and nothing else. A background thread turns them into text:
+ *
+ *   METRICS_FILE = ga.prom    rewritten every METRICS_INTERVAL seconds
+ *                             (default 5) through a rename, so readers
+ *                             such as node_exporter's textfile collector
+ *                             never see half a file
+ *   METRICS_PORT = 9464       served over HTTP on 127.0.0.1, any path
+ *
+ * Either or both can be set. Rates (generations and evaluations per
+ * second) are worked out by that thread over the time since it last
+ * looked, so they never touch the generation loop.
+ */
+class metrics {
+
+ public:
+  metrics( const char *, int, double );
+  ~metrics( void );
+
+  void publish( population * );
+
+ protected:
+
+ private:
+  static void *exporter( void * );
+  void render( string & );
+  void write_file( void );
+  void answer( int );
+
+  atomic<unsigned int> generation;
+  atomic<unsigned int> size;
+  atomic<unsigned int> clones;
+  atomic<double> best;
+  atomic<double> average;
+  atomic<double> stdev;
+  atomic<double> mutation_rate;
+  atomic<bool> screening;
+  atomic<unsigned long> skipped;
+  atomic<double> hit_rate;
+  atomic<double> prediction_error;
+
+  // Exporter thread only
+  double last_time;
+  unsigned int last_generation;
+  unsigned long last_evaluations;
+  double generation_rate;
+  double evaluation_rate;
+
+  char *filename;
+  double interval;
+  int listener;
+
+  pthread_t tid;
+  atomic<bool> stopping;
+};
+
+extern metrics *monitor;
+
+#endif
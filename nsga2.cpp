@@ -0,0 +1,432 @@
+#include "nsga2.h"
+#include "genome.h"
+
+#include <errno.h>
+#include <algorithm>
+
+/*-- Lexicographic, every objective in turn --*/
+struct by_objectives {
+  const float *values;
+  int M;
+  by_objectives( const float *v, int m ) : values(v), M(m) {}
+  bool operator() ( int a, int b ) const {
+    const float *x = values + a*M, *y = values + b*M;
+    for ( int m=0; m<M; m++ )
+      if ( x[m] != y[m] )
+	return x[m] < y[m];
+    return false;
+  }
+};
+
+/*-- By a single objective --*/
+struct by_objective {
+  const float *values;
+  int M, m;
+  by_objective( const float *v, int n, int k ) : values(v), M(n), m(k) {}
+  bool operator() ( int a, int b ) const { return values[a*M + m] < values[b*M + m]; }
+};
+
+/*-- Most crowding distance, i.e. the least crowded, first --*/
+struct by_crowding {
+  const float *crowding;
+  by_crowding( const float *c ) : crowding(c) {}
+  bool operator() ( int a, int b ) const { return crowding[a] > crowding[b]; }
+};
+
+nsga2::nsga2( population *society ) {
+
+  this->society = society;
+  this->size = society->last->count;
+  this->M = params->OBJECTIVES;
+
+  if ( this->M < 2 ) {
+    fprintf(stderr, "NSGA-II needs OBJECTIVES set to 2 or more, not %i\n", this->M);
+    exit(EINVAL);
+  }
+  if ( params->WORKERS && *params->WORKERS ) {
+    fprintf(stderr, "Remote workers only send back fitness, NSGA-II can't be used with WORKERS\n");
+    exit(EINVAL);
+  }
+  if ( this->size < 4 ) {
+    fprintf(stderr, "NSGA-II needs a population of at least 4, not %i\n", this->size);
+    exit(EINVAL);
+  }
+
+  // Anyone loaded from a checkpoint or population file comes without objectives
+  vector<individual *> unknown;
+  individual *person = society->first;
+  for ( int i=0; i<this->size && person; i++, person = person->next ) {
+    this->members.push_back(person);
+    this->offspring.push_back(new individual());
+    if ( isnan(person->objective[0]) )
+      unknown.push_back(person);
+  }
+  if ( !unknown.empty() )
+    optimizer::evaluate(unknown);
+
+  this->pool.resize(2*this->size);
+  this->values.resize(2*this->size*this->M);
+  this->rank.resize(2*this->size);
+  this->crowding.resize(2*this->size);
+  this->member_rank.resize(this->size);
+  this->member_crowding.resize(this->size);
+
+  // Rank the starting population on its own, so the first tournaments have something to go on
+  for ( int i=0; i<this->size; i++ )
+    this->pool[i] = this->members[i];
+  this->survivors(this->size);
+  for ( int k=0; k<this->size; k++ ) {
+    int e = this->order[k];
+    this->members[k] = this->pool[e];
+    this->member_rank[k] = this->rank[e];
+    this->member_crowding[k] = this->crowding[e];
+  }
+  this->relink();
+  society->mostfit = this->fittest();
+
+  return;
+}
+
+nsga2::~nsga2( void ) {
+  for ( unsigned int i=0; i<this->offspring.size(); i++ )
+    delete this->offspring[i];
+  return;
+}
+
+/*-- Binary tournament on front, then crowding distance --*/
+int nsga2::tournament( void ) {
+  int a = randl() % this->size;
+  int b = randl() % this->size;
+
+  if ( this->member_rank[a] != this->member_rank[b] )
+    return this->member_rank[a] < this->member_rank[b] ? a : b;
+  return this->member_crowding[a] >= this->member_crowding[b] ? a : b;
+}
+
+void nsga2::step( void ) {
+
+  uint64_t span = trace_begin();
+  genome *engine = genome::current();
+
+  for ( int i=0; i<this->size; i++ ) {
+    individual *daddy = this->members[this->tournament()];
+    individual *mommy = this->members[this->tournament()];
+    individual *child = this->offspring[i];
+
+    engine->crossover(daddy->gene, mommy->gene, child->gene);
+    child->mutation_rate = genome::adapt(daddy->mutation_rate, mommy->mutation_rate);
+    if ( child->mutation_rate > 0.0f )
+      engine->mutate(child->gene, child->mutation_rate);
+    child->generation = 0;
+    child->objective[0] = numeric_limits<float>::quiet_NaN();
+  }
+  span = trace_mark("offspring", span);
+
+  optimizer::evaluate(this->offspring);
+  span = trace_mark("evaluation", span);
+
+  for ( int i=0; i<this->size; i++ ) {
+    this->pool[i] = this->members[i];
+    this->pool[this->size + i] = this->offspring[i];
+  }
+  this->survivors(2*this->size);
+  span = trace_mark("sorting", span);
+
+  // Surviving children take the places of the parents that didn't survive
+  vector<bool> kept(this->size, false);
+  for ( int k=0; k<this->size; k++ )
+    if ( this->order[k] < this->size )
+      kept[this->order[k]] = true;
+
+  int slot = 0;
+  vector<individual *> next(this->size);
+  for ( int k=0; k<this->size; k++ ) {
+    int e = this->order[k];
+    if ( e < this->size ) {
+      next[k] = this->members[e];
+      next[k]->generation++;
+    } else {
+      while ( kept[slot] )
+	slot++;
+      next[k] = this->members[slot++];
+      next[k]->copy(this->offspring[e - this->size]);
+    }
+    this->member_rank[k] = this->rank[e];
+    this->member_crowding[k] = this->crowding[e];
+  }
+  this->members.swap(next);
+  this->relink();
+  trace_end("selection", span);
+
+  this->society->generation++;
+  this->society->get_statistics();
+  this->society->mostfit = this->fittest();
+
+  return;
+}
+
+/*-- The population stays in front order; mostfit is only the best scalar fitness --*/
+void nsga2::finish( void ) {
+  this->society->check_for_clones();
+  this->society->recount();
+  return;
+}
+
+/*-- Leaves the best size of the first count pool entries at the front of order, in (front, crowding) order --*/
+void nsga2::survivors( int count ) {
+
+  this->gather(count);
+  this->order.clear();
+  this->fronts.clear();
+  if ( this->M == 2 )
+    this->sweep(count);
+  else
+    this->peel(count, this->size);
+
+  for ( unsigned int f=0; f+1<this->fronts.size() && this->fronts[f]<this->size; f++ ) {
+    this->crowd(this->fronts[f], this->fronts[f+1]);
+    sort(this->order.begin() + this->fronts[f], this->order.begin() + this->fronts[f+1],
+	 by_crowding(&this->crowding[0]));
+  }
+
+  return;
+}
+
+/*-- Objectives into one contiguous block, checking the fitness library filled them all in --*/
+void nsga2::gather( int count ) {
+
+  for ( int i=0; i<count; i++ ) {
+    const float *objective = this->pool[i]->objective;
+    for ( int m=0; m<this->M; m++ ) {
+      if ( isnan(objective[m]) ) {
+	fprintf(stderr, "The fitness library didn't set objective %i of %i\n", m, this->M);
+	exit(EINVAL);
+      }
+      this->values[i*this->M + m] = objective[m];
+    }
+  }
+
+  return;
+}
+
+/*
+ * Two objectives: in (f0, f1) order nobody can be dominated by anyone
+ * after them, and the last member placed in each front has that front's
+ * least f1, rising from front to front, so a binary search over those
+ * finds the first front that doesn't dominate each newcomer.
+ */
+void nsga2::sweep( int count ) {
+
+  const float *v = &this->values[0];
+
+  this->sorted.resize(count);
+  for ( int i=0; i<count; i++ )
+    this->sorted[i] = i;
+  sort(this->sorted.begin(), this->sorted.end(), by_objectives(v, 2));
+
+  this->last.clear();
+  for ( int i=0; i<count; i++ ) {
+    int p = this->sorted[i];
+    int lo = 0, hi = this->last.size();
+    while ( lo < hi ) {
+      int mid = (lo + hi)/2;
+      int q = this->last[mid];
+      if ( v[2*q+1] <= v[2*p+1] && (v[2*q] < v[2*p] || v[2*q+1] < v[2*p+1]) )
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+    if ( lo == (int)this->last.size() )
+      this->last.push_back(p);
+    else
+      this->last[lo] = p;
+    this->rank[p] = lo;
+  }
+
+  // Counting sort into fronts
+  int nfronts = this->last.size();
+  this->fronts.assign(nfronts + 1, 0);
+  for ( int i=0; i<count; i++ )
+    this->fronts[this->rank[i] + 1]++;
+  for ( int f=0; f<nfronts; f++ )
+    this->fronts[f+1] += this->fronts[f];
+
+  vector<int> fill(this->fronts.begin(), this->fronts.end() - 1);
+  this->order.resize(count);
+  for ( int i=0; i<count; i++ )
+    this->order[fill[this->rank[i]]++] = i;
+
+  return;
+}
+
+/*
+ * Any number of objectives: one pass over the pairs, in lexicographic
+ * order, sets a bit for each domination and counts how many dominate each entry, then fronts are
+ * peeled off by walking the set bits of the current front's rows, until
+ * at least needed entries have a front.
+ */
+void nsga2::peel( int count, int needed ) {
+
+  const int M = this->M;
+  const int words = (count + 63)/64;
+
+  this->dominates.assign((size_t)count*words, 0);
+  this->dominated.assign(count, 0);
+
+  // In lexicographic order nobody can dominate anyone before them, which halves the tests
+  this->sorted.resize(count);
+  for ( int i=0; i<count; i++ )
+    this->sorted[i] = i;
+  sort(this->sorted.begin(), this->sorted.end(), by_objectives(&this->values[0], M));
+
+  for ( int s=0; s<count; s++ ) {
+    const int i = this->sorted[s];
+    const float *a = &this->values[i*M];
+    uint64_t *row = &this->dominates[(size_t)i*words];
+    for ( int t=s+1; t<count; t++ ) {
+      const int j = this->sorted[t];
+      const float *b = &this->values[j*M];
+      bool better = false;
+      int m = 0;
+      for ( ; m<M && a[m] <= b[m]; m++ )
+	better |= a[m] < b[m];
+      if ( m == M && better ) {
+	row[j/64] |= (uint64_t)1 << (j%64);
+	this->dominated[j]++;
+      }
+    }
+  }
+
+  for ( int i=0; i<count; i++ )
+    if ( !this->dominated[i] ) {
+      this->rank[i] = 0;
+      this->order.push_back(i);
+    }
+
+  int start = 0;
+  for ( int r=1; start < (int)this->order.size(); r++ ) {
+    int end = this->order.size();
+    this->fronts.push_back(start);
+    if ( end >= needed )
+      break;
+
+    for ( int k=start; k<end; k++ ) {
+      const uint64_t *row = &this->dominates[(size_t)this->order[k]*words];
+      for ( int w=0; w<words; w++ )
+	for ( uint64_t bits = row[w]; bits; bits &= bits - 1 ) {
+	  int j = w*64 + __builtin_ctzll(bits);
+	  if ( --this->dominated[j] == 0 ) {
+	    this->rank[j] = r;
+	    this->order.push_back(j);
+	  }
+	}
+    }
+    start = end;
+  }
+  this->fronts.push_back(this->order.size());
+
+  return;
+}
+
+/*-- Crowding distance across order[begin, end), one front --*/
+void nsga2::crowd( int begin, int end ) {
+
+  const int n = end - begin;
+  const float *v = &this->values[0];
+
+  for ( int k=begin; k<end; k++ )
+    this->crowding[this->order[k]] = (n > 2) ? 0.0f : INFINITY;
+  if ( n <= 2 )
+    return;
+
+  this->sorted.assign(this->order.begin() + begin, this->order.begin() + end);
+  for ( int m=0; m<this->M; m++ ) {
+    sort(this->sorted.begin(), this->sorted.end(), by_objective(v, this->M, m));
+
+    float lo = v[this->sorted[0]*this->M + m];
+    float hi = v[this->sorted[n-1]*this->M + m];
+    this->crowding[this->sorted[0]] = this->crowding[this->sorted[n-1]] = INFINITY;
+    if ( hi <= lo )
+      continue;
+
+    float scale = 1.0f/(hi - lo);
+    for ( int k=1; k<n-1; k++ )
+      this->crowding[this->sorted[k]] +=
+	(v[this->sorted[k+1]*this->M + m] - v[this->sorted[k-1]*this->M + m])*scale;
+  }
+
+  return;
+}
+
+/*-- The list follows members --*/
+void nsga2::relink( void ) {
+
+  for ( int k=0; k<this->size; k++ ) {
+    individual *person = this->members[k];
+    person->count = k + 1;
+    person->previous = k ? this->members[k-1] : NULL;
+    person->next = (k+1 < this->size) ? this->members[k+1] : NULL;
+  }
+  this->society->first = this->members[0];
+  this->society->last = this->members[this->size-1];
+
+  return;
+}
+
+individual *nsga2::fittest( void ) {
+  individual *best = this->members[0];
+  for ( int k=1; k<this->size; k++ )
+    if ( this->members[k]->fitness < best->fitness )
+      best = this->members[k];
+  return best;
+}
+
+/*-- The first front, the Pareto archive, to the console and PARETO_FILE --*/
+bool nsga2::dump( void ) {
+
+  int n = 0;
+  while ( n < this->size && this->member_rank[n] == 0 )
+    n++;
+
+  if ( params->DUMP_N_TOP > 0 ) {
+    log_printf("\nPareto front, %i of %i\n", n, this->size);
+    for ( int k=0; k<n; k++ ) {
+      individual *person = this->members[k];
+      log_int(person->count, 3);
+      log_str(" (");
+      for ( int i=0; i<params->NUMBER_OF_GENES; i++ ) {
+	log_char(' ');
+	log_fixed((double)gene_value(person->gene[i]), params->ACCURACY, true);
+	log_char(',');
+      }
+      log_str("\b )\t=> objectives = ");
+      for ( int m=0; m<this->M; m++ ) {
+	if ( m )
+	  log_str(", ");
+	log_fixed(person->objective[m], params->ACCURACY);
+      }
+      log_char('\n');
+    }
+  }
+
+  if ( params->PARETO_FILE && *params->PARETO_FILE ) {
+    FILE *pFile = fopen(params->PARETO_FILE, "w");
+    if ( !pFile ) {
+      perror(params->PARETO_FILE);
+      return true;
+    }
+    fprintf(pFile, "# %i objectives then %i genes, one member of the first front per line\n",
+	    this->M, params->NUMBER_OF_GENES);
+    for ( int k=0; k<n; k++ ) {
+      individual *person = this->members[k];
+      for ( int m=0; m<this->M; m++ )
+	fprintf(pFile, "%s%.*g", m ? "\t" : "", 9, person->objective[m]);
+      for ( int i=0; i<params->NUMBER_OF_GENES; i++ )
+	fprintf(pFile, "\t%.*g", 17, (double)gene_value(person->gene[i]));
+      fprintf(pFile, "\n");
+    }
+    fclose(pFile);
+  }
+
+  return true;
+}
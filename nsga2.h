@@ -0,0 +1,76 @@
+#ifndef __NSGA2_H
+#define __NSGA2_H
+
+#include "optimizer.h"
+
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+/*
+ * NSGA-II, for fitness functions with more than one objective:
+ * OPTIMIZER = NSGA2 in ga.rcp, with OBJECTIVES set to how many there are.
+ * The fitness library fills in individual::objective[0..OBJECTIVES), all
+ * of them minimized; fitness is still whatever the library puts there and
+ * is only used for the status line and mostfit.
+ *
+ * Each generation N children are bred by binary crowded tournaments,
+ * crossover and mutation, and evaluated as one batch. Parents and
+ * children together are sorted into non-dominated fronts: with two
+ * objectives by a sweep in objective order that places each point with a
+ * binary search over the fronts' last members (O(N log N)), otherwise by
+ * peeling fronts off a bitset of who dominates whom, which stops once
+ * enough of them are in hand. The best N by (front, crowding distance)
+ * survive; surviving children are copied over the parents that didn't,
+ * and the list is relinked in that order, so the first front comes first.
+ *
+ * dump() prints the first front, the Pareto archive, in place of the
+ * usual top N and writes it to PARETO_FILE if that's set.
+ */
+class nsga2 : public optimizer {
+
+ public:
+  nsga2( population * );
+  ~nsga2( void );
+
+  void step( void );
+  void finish( void );
+  bool dump( void );
+  const char *name( void ) { return "NSGA-II"; }
+
+ protected:
+
+ private:
+  void survivors( int );
+  void gather( int );
+  void sweep( int );
+  void peel( int, int );
+  void crowd( int, int );
+  int tournament( void );
+  void relink( void );
+  individual *fittest( void );
+
+  population *society;
+  int size;
+  int M;
+
+  vector<individual *> members;     // the population, in (front, crowding) order
+  vector<int> member_rank;
+  vector<float> member_crowding;
+  vector<individual *> offspring;
+  vector<individual *> pool;        // members then offspring, while sorting
+
+  vector<float> values;             // pool x M objectives, contiguous
+  vector<int> rank;                 // front of each pool entry
+  vector<float> crowding;
+  vector<int> order;                // pool entries, front by front
+  vector<int> fronts;               // where each front starts in order, and where the last ends
+  vector<int> sorted;               // scratch, in objective order
+  vector<int> last;                 // the last member placed in each front by sweep()
+
+  vector<uint64_t> dominates;       // pool x pool bits, row i has j set if i dominates j
+  vector<int> dominated;            // how many dominate each entry
+};
+
+#endif
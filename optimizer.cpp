@@ -0,0 +1,45 @@
+#include "optimizer.h"
+#include "cmaes.h"
+#include "de.h"
+#include "nsga2.h"
+
+#include <errno.h>
+
+/*-- The engine OPTIMIZER asks for, or NULL for the GA --*/
+optimizer *optimizer::select( population *society ) {
+
+  string name = params->OPTIMIZER;
+  optimizer *chosen = NULL;
+
+  if ( name == "" || name == "GA" )
+    return NULL;
+  else if ( name == "CMAES" || name == "CMA-ES" )
+    chosen = new cmaes( society );
+  else if ( name == "DE" )
+    chosen = new differential_evolution( society );
+  else if ( name == "NSGA2" || name == "NSGA-II" )
+    chosen = new nsga2( society );
+  else {
+    fprintf(stderr, "Unknown OPTIMIZER %s\n", name.c_str());
+    exit(EINVAL);
+  }
+
+  if ( params->VERBOSE > 1 )
+    fprintf(stderr, "Using the %s optimizer\n", chosen->name());
+  return chosen;
+}
+
+/*-- One batch through the thread pool or remote workers, or one by one without them --*/
+void optimizer::evaluate( vector<individual *> &batch ) {
+
+  if ( params->ASYNC_FITNESS )
+    lock();
+  for ( unsigned int i=0; i<batch.size(); i++ )
+    getFitness((void *)batch[i]);
+  if ( params->ASYNC_FITNESS ) {
+    unlock();
+    wait_for_threads();
+  }
+
+  return;
+}
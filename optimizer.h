@@ -0,0 +1,40 @@
+#ifndef __OPTIMIZER_H
+#define __OPTIMIZER_H
+
+#include "global.h"
+#include "population.h"
+#include "individual.h"
+
+#include <vector>
+
+using namespace std;
+
+/*-- From the fitness library: true if the function in use fills in individual::objective[] --*/
+bool fitness_objectives( void );
+
+/*
+ * Optimizers other than the GA's own mate(), chosen with OPTIMIZER in
+ * ga.rcp (GA, the default, leaves it to mate()). They work on the same
+ * population, the same gene bounds and the same fitness library. main
+ * calls step() once a generation in place of mate(), and finish() when
+ * it's done, which leaves the population sorted, best first, with the
+ * best individual found in it. dump() replaces the population's own
+ * dump(DUMP_N_TOP) at the end of the run if it returns true.
+ */
+class optimizer {
+
+ public:
+  virtual ~optimizer( void ) {}
+
+  virtual void step( void ) = 0;
+  virtual void finish( void ) = 0;
+  virtual const char *name( void ) = 0;
+  virtual bool dump( void ) { return false; }
+
+  static optimizer *select( population * );
+
+ protected:
+  static void evaluate( vector<individual *> & );
+};
+
+#endif
@@ -1,9 +1,129 @@
 #include "parameters.h"
 
+#include <math.h>
+
+/*-- Split off the next whitespace delimited token, in place --*/
+static char *next_token( char **p ) {
+
+  char *start = *p;
+  while ( *start == ' ' || *start == '\t' || *start == '\r' || *start == '\n' )
+    start++;
+
+  char *end = start;
+  while ( *end && *end != ' ' && *end != '\t' && *end != '\r' && *end != '\n' )
+    end++;
+
+  *p = *end ? end + 1 : end;
+  *end = '\0';
+  return start;
+}
+
+/*
+ * Read up to n numbers separated by commas and/or whitespace, in one pass.
+ * A '#' comments out the rest of its line. If fewer than n numbers are
+ * given the last one is repeated, as it always has been.
+ */
+static void parse_array( const char *key, const char *p, double *array, int n ) {
+
+  int i = 0;
+  double number = 0.0;
+
+  while ( *p ) {
+    if ( *p == ' ' || *p == '\t' || *p == ',' || *p == '\r' || *p == '\n' ) {
+      p++;
+      continue;
+    }
+    if ( *p == '#' ) {
+      while ( *p && *p != '\n' )
+	p++;
+      continue;
+    }
+
+    char *end;
+    number = strtod(p, &end);
+    if ( end == p ) {
+      fprintf(stderr, "%s: can't read a number from \"%.16s\"\n", key, p);
+      exit(EINVAL);
+    }
+    if ( i >= n ) {
+      fprintf(stderr, "%s: more than NUMBER_OF_GENES (%i) values\n", key, n);
+      exit(EINVAL);
+    }
+    array[i++] = number;
+    p = end;
+  }
+
+  for ( ; i<n; i++ )
+    array[i] = number;
+
+  return;
+}
+
+/*-- "@file": raw host order doubles if it ends in .bin, otherwise text --*/
+static void load_array( const char *key, const char *file, double *array, int n ) {
+
+  errno = 0;
+  FILE *pFile = fopen(file, "r");
+  if ( !pFile ) {
+    perror(file);
+    exit(errno);
+  }
+
+  fseek(pFile, 0, SEEK_END);
+  long bytes = ftell(pFile);
+  rewind(pFile);
+
+  size_t length = strlen(file);
+  if ( length > 4 && !strcmp(file + length - 4, ".bin") ) {
+    if ( bytes != (long)(n*sizeof(double)) ||
+	 fread(array, sizeof(double), n, pFile) != (size_t)n ) {
+      fprintf(stderr, "%s: %s should hold exactly %i doubles\n", key, file, n);
+      exit(EINVAL);
+    }
+  } else {
+    char *text = new char [bytes+1];
+    text[fread(text, 1, bytes, pFile)] = '\0';
+    parse_array(key, text, array, n);
+    delete [] text;
+  }
+
+  fclose(pFile);
+  return;
+}
+
+/*-- LOWER_LIMITS and UPPER_LIMITS, inline or from "@file" --*/
+void parameters::read_array( const char *filename, const char *key, char *text ) {
+
+  store(key, PARAM_ARRAY, Values());
+
+  double *array = NULL;
+  if ( !strcmp(key, "LOWER_LIMITS") )
+    array = pLO;
+  else if ( !strcmp(key, "UPPER_LIMITS") )
+    array = pHI;
+  else
+    return;
+
+  if ( !array ) {
+    fprintf(stderr, "%s: NUMBER_OF_GENES has to come before %s\n", filename, key);
+    exit(EINVAL);
+  }
+
+  while ( *text == ' ' || *text == '\t' )
+    text++;
+
+  if ( *text == '@' ) {
+    text++;
+    load_array(key, next_token(&text), array, getInt("NUMBER_OF_GENES"));
+  } else
+    parse_array(key, text, array, getInt("NUMBER_OF_GENES"));
+
+  return;
+}
+
 parameters::parameters( char * filename ) {
 
   FILE *pFile;
-  char inStream[256];
 
   /*-- Now, try to read in the parameter file --*/
   errno = 0;
@@ -12,13 +132,17 @@ parameters::parameters( char * filename ) {
     exit(errno);
   }
 
-  char key[256], value[256], type[32];
+  pLO = pHI = NULL;
+
+  // Slot 0 stands in for every parameter that isn't given
+  table.push_back(Values());
+  types.push_back(PARAM_NONE);
 
-  memset( (void *)key,   0, 256*sizeof(char));
-  memset( (void *)value, 0, 256*sizeof(char));
-  memset( (void *)type,  0,   32*sizeof(char));
+  // getline() grows the buffer as needed, so lines (and arrays) can be any length
+  char *inStream = NULL;
+  size_t capacity = 0;
 
-  while ( fgets(inStream, 255, pFile) != NULL ) {
+  while ( getline(&inStream, &capacity, pFile) > 0 ) {
 
     if ( inStream[0] == '#' )
       continue;
@@ -26,94 +150,71 @@ parameters::parameters( char * filename ) {
     if ( !strncmp(inStream, "EOF", 3) )
       break;
 
-    sscanf(inStream, "%s %s = %s %*s", type, key, value);
+    char *p = inStream;
+    char *type = next_token(&p);
+    char *key  = next_token(&p);
+    char *eq   = next_token(&p);
 
     if ( !strncmp(type, "EOF", 3) )
       break;
 
-    if ( !type[0] || !key[0] || !value[0] || type[0] == '#' || type[0] == ' ' )
+    if ( !type[0] || !key[0] || strcmp(eq, "=") || type[0] == '#' )
       continue;
 
-    if ( !strcmp(type, "int") ) {
-      if ( strstr( (const char *)inStream, "inf" ) || strstr( (const char *)inStream, "INF" ) )
-	pMap[key] = MAX_INT;
-      else
-	pMap[key] = atoi(value);
+    // Arrays take the rest of the line (or a file), everything else one token
+    if ( !strcmp(type, "float_array") ) {
+      this->read_array(filename, key, p);
+      continue;
     }
 
-    if ( !strcmp(type, "long") ) {
-      if ( strstr( (const char *)inStream, "inf" ) || strstr( (const char *)inStream, "INF" ) )
-	pMap[key] = MAX_INT;
-      else
-	pMap[key] = atol(value);
-    }
+    char *value = next_token(&p);
+    if ( !value[0] )
+      continue;
 
-    if ( !strcmp(type, "ulong") ) {
-      if ( strstr( (const char *)inStream, "inf" ) || strstr( (const char *)inStream, "INF" ) )
-	pMap[key] = MAX_INT;
-      else
-	pMap[key] = abs(atol(value));
-    }
+    bool infinite = strstr(value, "inf") || strstr(value, "INF");
 
-    else if ( !strcmp(type, "uint") ) {
-      if ( strstr( (const char *)inStream, "inf" ) || strstr( (const char *)inStream, "INF" ) )
-	pMap[key] = MAX_INT;
-      else
-	pMap[key] = abs(atoi(value));
-    }
+    if ( !strcmp(type, "int") )
+      store(key, PARAM_INT, infinite ? MAX_INT : atoi(value));
+
+    else if ( !strcmp(type, "long") )
+      store(key, PARAM_LONG, infinite ? (long)MAX_INT : atol(value));
+
+    else if ( !strcmp(type, "ulong") )
+      store(key, PARAM_LONG, infinite ? (long)MAX_INT : labs(atol(value)));
+
+    else if ( !strcmp(type, "uint") )
+      store(key, PARAM_INT, infinite ? MAX_INT : abs(atoi(value)));
 
     else if ( !strcmp(type, "string") ) {
-      pMap[key] = new char [strlen(value)+2];
-      strcpy(pMap[key], value);
+      char *copy = new char [strlen(value)+2];
+      strcpy(copy, value);
+      store(key, PARAM_STRING, copy);
     }
 
     else if ( !strcmp(type, "float") || !strcmp(type, "double") )
-      pMap[key] = strtod(value, (char **)NULL);
+      store(key, PARAM_DOUBLE, strtod(value, (char **)NULL));
 
     else if ( !strcmp(type, "bool") )
-      pMap[key] = (!strcmp(value, "true")) ? true : false;
-
-    else if ( !strcmp(type, "float_array") ) {
-
-      char temp[11 + 4*pMap["NUMBER_OF_GENES"].asInt];
-      inStream[strlen(inStream)-1] = '\0';
-      double number = 0.0f;
-
-      for (int i=0; i<pMap["NUMBER_OF_GENES"].asInt; i++) {
-	strcpy( temp, "%*s %*s = " );
-
-	for (int j=0; j<i; j++)
-	  strcat(temp, "%*f, ");
-	strcat(temp, "%lf\0");
- 
-	if ( !strcmp(key, "LOWER_LIMITS") ) {
-	  sscanf(inStream, temp, &number);
-	  pLO[i] = number;
-	}
-	else if ( !strcmp(key, "UPPER_LIMITS") ) {
-	  sscanf(inStream, temp, &number);
-	  pHI[i] = (double)number;
-	}
-      }
-    }
+      store(key, PARAM_BOOL, (!strcmp(value, "true")) ? true : false);
 
     if ( !strcmp(key, "NUMBER_OF_GENES") ) {
-      pLO = new double[pMap["NUMBER_OF_GENES"].asInt];
-      pHI = new double[pMap["NUMBER_OF_GENES"].asInt];
+      delete [] pLO;
+      delete [] pHI;
+      pLO = new double[getInt("NUMBER_OF_GENES")];
+      pHI = new double[getInt("NUMBER_OF_GENES")];
     }
-
-    memset( (void *)key,   0, 128*sizeof(char));
-    memset( (void *)value, 0, 128*sizeof(char));
-    memset( (void *)type,  0,   16*sizeof(char));
   }
 
-  if ( pMap.count("LOWER_LIMIT_ALL") ) {
-    for ( int i=0; i<pMap["NUMBER_OF_GENES"].asInt; i++ )
-      pLO[i] = pMap["LOWER_LIMIT_ALL"].asDouble;
+  free(inStream);
+  fclose(pFile);
+
+  if ( has("LOWER_LIMIT_ALL") ) {
+    for ( int i=0; i<getInt("NUMBER_OF_GENES"); i++ )
+      pLO[i] = getDouble("LOWER_LIMIT_ALL");
   }
-  if ( pMap.count("UPPER_LIMIT_ALL") ) {
-    for ( int i=0; i<pMap["NUMBER_OF_GENES"].asInt; i++ )
-      pHI[i] = pMap["UPPER_LIMIT_ALL"].asDouble;
+  if ( has("UPPER_LIMIT_ALL") ) {
+    for ( int i=0; i<getInt("NUMBER_OF_GENES"); i++ )
+      pHI[i] = getDouble("UPPER_LIMIT_ALL");
   }
 
   // Hard wire all the internal stuff we know we'll need so that access is faster
@@ -134,10 +235,37 @@ parameters::parameters( char * filename ) {
   INITIAL_POPULATION     = getInt("INITIAL_POPULATION");
   NUMBER_OF_GENES        = getInt("NUMBER_OF_GENES");
   MUTATION_RATE          = getFloat("MUTATION_RATE");
-  MUTATION_GAIN          = getFloat("MUTATION_GAIN");
+  MUTATE_SIMPLE          = getBool("MUTATE_SIMPLE");
+  MUTATION_TAU           = has("MUTATION_TAU") ? getFloat("MUTATION_TAU") : 1.0/sqrt(2.0*NUMBER_OF_GENES);
   SORT_TYPE              = getString("SORT_TYPE");
   NUM_THREADS            = getUInt("NUM_THREADS");
   SEED                   = getULong("SEED");
+  WORKERS                = getString("WORKERS");
+  CHECKPOINT_FILE        = getString("CHECKPOINT_FILE");
+  CHECKPOINT_FREQ        = getInt("CHECKPOINT_FREQ");
+  RESUME                 = getBool("RESUME");
+  SEED_POPULATION        = getString("SEED_POPULATION");
+  SEED_FRACTION          = has("SEED_FRACTION") ? getFloat("SEED_FRACTION") : 1.0f;
+  SEED_FILL              = getString("SEED_FILL");
+  FITNESS_VERSION        = getUInt("FITNESS_VERSION");
+  EXPORT_POPULATION      = getString("EXPORT_POPULATION");
+  PHASE_TIMING           = getInt("PHASE_TIMING");
+  PHASE_FILE             = getString("PHASE_FILE");
+  PERF_COUNTERS          = getInt("PERF_COUNTERS");
+  PERF_FILE              = getString("PERF_FILE");
+  TRACE_FILE             = getString("TRACE_FILE");
+  METRICS_FILE           = getString("METRICS_FILE");
+  METRICS_PORT           = getInt("METRICS_PORT");
+  METRICS_INTERVAL       = has("METRICS_INTERVAL") ? getFloat("METRICS_INTERVAL") : 5.0f;
+  STEADY_STATE           = getBool("STEADY_STATE");
+  OPTIMIZER              = has("OPTIMIZER") ? getString("OPTIMIZER") : "GA";
+  OBJECTIVES             = getInt("OBJECTIVES");
+  PARETO_FILE            = getString("PARETO_FILE");
+  SURROGATE              = getBool("SURROGATE");
+  PIPELINE               = getBool("PIPELINE");
+
+  // Fitness values arrive later whenever they are computed by threads or remote workers
+  ASYNC_FITNESS          = NUM_THREADS || (WORKERS && *WORKERS);
 
   return;
 }
@@ -145,87 +273,113 @@ parameters::parameters( char * filename ) {
 parameters::~parameters( void ) {
   delete [] pLO;
   delete [] pHI;
-  delete [] pMap["FITNESS_FUNCTION"];
+  for ( unsigned int i=0; i<table.size(); i++ )
+    if ( types[i] == PARAM_STRING )
+      delete [] table[i].asCString;
+  return;
+}
+
+/*-- Later definitions of a key replace earlier ones, in the same slot --*/
+void parameters::store( const char *key, param_type type, Values value ) {
+
+  paramMap::iterator it = pMap.find(key);
+  if ( it != pMap.end() ) {
+    if ( types[it->second] == PARAM_STRING )
+      delete [] table[it->second].asCString;
+    table[it->second] = value;
+    types[it->second] = type;
+    return;
+  }
+
+  pMap[key] = table.size();
+  table.push_back(value);
+  types.push_back(type);
   return;
 }
 
+Values parameters::lookup( string key ) {
+  paramMap::iterator it = pMap.find(key);
+  return ( it != pMap.end() ) ? table[it->second] : table[0];
+}
+
+bool parameters::has( string key ) {
+  return pMap.count(key);
+}
+
+/*
+ * Resolve a key to a handle, making sure it was declared with the type
+ * the caller is going to read it as. Mismatches, and missing keys the
+ * caller can't do without, stop the program here rather than turning up
+ * as garbage in the middle of a run.
+ */
+param_handle parameters::handle( string key, param_type type, bool required ) {
+
+  static const char *names[] = { "undefined", "int", "long", "bool", "float", "string", "float_array" };
+  param_handle h = { 0, type };
+
+  paramMap::iterator it = pMap.find(key);
+  if ( it == pMap.end() ) {
+    if ( required ) {
+      fprintf(stderr, "Parameter %s (%s) is required\n", key.c_str(), names[type]);
+      exit(EINVAL);
+    }
+    return h;
+  }
+
+  if ( types[it->second] != type ) {
+    fprintf(stderr, "Parameter %s is declared %s, but used as %s\n",
+	    key.c_str(), names[types[it->second]], names[type]);
+    exit(EINVAL);
+  }
+
+  h.slot = it->second;
+  return h;
+}
+
 unsigned long parameters::getULong( string key ) {
-    if ( this->pMap.count(key) )
-    return this->pMap[key].asULong;
-  else
-    return 0;
+  return lookup(key).asULong;
 }
 
 bool parameters::getBool( string key ) {
-    if ( this->pMap.count(key) )
-      return this->pMap[key].asBool;
-    else
-      return false;
+  return lookup(key).asBool;
 }
 
 int parameters::getInt( string key ) {
-    if ( this->pMap.count(key) )
-      return this->pMap[key].asInt;
-    else
-      return 0;
+  return lookup(key).asInt;
 }
 
 float parameters::getFloat( string key ) {
-  if ( this->pMap.count(key) )
-    return (float)this->pMap[key].asDouble;
-  else
-    return 0.0;
+  return (float)lookup(key).asDouble;
 }
 
 double parameters::getDouble( string key ) {
-  if ( this->pMap.count(key) )
-    return this->pMap[key].asDouble;
-  else
-    return 0.0;
+  return lookup(key).asDouble;
 }
 
 char * parameters::getString( string key ) {
-      if ( this->pMap.count(key) )
-    return this->pMap[key].asCString;
-  else
-    return '\0';
+  return lookup(key).asCString;
 }
 
 unsigned int parameters::getLong( string key ) {
-    if ( this->pMap.count(key) )
-    return this->pMap[key].asLong;
-  else
-    return 0;
+  return lookup(key).asLong;
 }
 
 unsigned int parameters::getUInt( string key ) {
-  if ( this->pMap.count(key) )
-    return this->pMap[key].asUInt;
-  else
-    return 0;
+  return lookup(key).asUInt;
 }
 
 /*
 
 char parameters::getChar( string key ) {
-    if ( this->pMap.count(key) )
-    return this->pMap[key].asChar;
-  else
-    return '\0';
+  return lookup(key).asChar;
 }
 
 short parameters::getShort( string key ) {
-    if ( this->pMap.count(key) )
-    return this->pMap[key].asShort;
-  else
-    return 0;
+  return lookup(key).asShort;
 }
 
 unsigned short parameters::getUShort( string key ) {
-    if ( this->pMap.count(key) )
-    return this->pMap[key].asUShort;
-  else
-    return 0;
+  return lookup(key).asUShort;
 }
 
 */
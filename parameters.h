@@ -4,6 +4,7 @@
 #include <iostream>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <fcntl.h>
 #include <errno.h>
@@ -63,7 +64,29 @@ union Values {
   operator char*() { return asCString; }
 };
 
-typedef unordered_map <string, Values> paramMap;
+/*-- The type a parameter was declared with in the parameter file --*/
+enum param_type {
+  PARAM_NONE = 0,
+  PARAM_INT,          // int and uint
+  PARAM_LONG,         // long and ulong
+  PARAM_BOOL,
+  PARAM_DOUBLE,       // float and double
+  PARAM_STRING,
+  PARAM_ARRAY         // float_array, stored in pLO/pHI
+};
+
+/*
+ * A parameter looked up once, by name and type, when the program (or the
+ * fitness library) starts. Reading through a handle is a plain array load,
+ * so it is fine inside the fitness evaluation loop. Keys that aren't in
+ * the parameter file resolve to slot 0, which always reads as zero.
+ */
+typedef struct {
+  unsigned int slot;
+  param_type type;
+} param_handle;
+
+typedef unordered_map <string, unsigned int> paramMap;
 
 class parameters {
 
@@ -80,6 +103,18 @@ class parameters {
   char * getString  ( string );
   uint   getLong    ( string );
   uint   getUInt    ( string );
+  bool   has        ( string );
+
+  param_handle handle ( string, param_type, bool required = false );
+
+  int    getInt     ( param_handle h ) { return table[h.slot].asInt; }
+  uint   getUInt    ( param_handle h ) { return table[h.slot].asUInt; }
+  long   getLong    ( param_handle h ) { return table[h.slot].asLong; }
+  ulong  getULong   ( param_handle h ) { return table[h.slot].asULong; }
+  bool   getBool    ( param_handle h ) { return table[h.slot].asBool; }
+  float  getFloat   ( param_handle h ) { return (float)table[h.slot].asDouble; }
+  double getDouble  ( param_handle h ) { return table[h.slot].asDouble; }
+  char * getString  ( param_handle h ) { return table[h.slot].asCString; }
 
   /*
   char   getChar    ( string );
@@ -107,17 +142,47 @@ class parameters {
   int INITIAL_POPULATION;
   int NUMBER_OF_GENES;
   float MUTATION_RATE;
-  float MUTATION_GAIN;
+  float MUTATION_TAU;
   string SORT_TYPE;
   uint NUM_THREADS;
   bool MUTATE_SIMPLE;
   unsigned long SEED;
+  char *WORKERS;
+  bool ASYNC_FITNESS;
+  char *CHECKPOINT_FILE;
+  int CHECKPOINT_FREQ;
+  bool RESUME;
+  char *SEED_POPULATION;
+  float SEED_FRACTION;
+  char *SEED_FILL;
+  uint FITNESS_VERSION;
+  char *EXPORT_POPULATION;
+  int PHASE_TIMING;
+  char *PHASE_FILE;
+  int PERF_COUNTERS;
+  char *PERF_FILE;
+  char *TRACE_FILE;
+  char *METRICS_FILE;
+  int METRICS_PORT;
+  float METRICS_INTERVAL;
+  bool STEADY_STATE;
+  string OPTIMIZER;
+  int OBJECTIVES;
+  char *PARETO_FILE;
+  bool SURROGATE;
+  bool PIPELINE;
 
  protected:
 
  private:
   
-  paramMap pMap;
+  void   store      ( const char *, param_type, Values );
+  void   read_array ( const char *, const char *, char * );
+  Values lookup     ( string );
+
+  paramMap pMap;                // name -> slot in table
+  vector<Values> table;
+  vector<param_type> types;
 
 };
 
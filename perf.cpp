@@ -0,0 +1,161 @@
+#include "perf.h"
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+perf_counters *counters = NULL;
+
+static const char *phase_names[PERF_PHASES] = { "breeding", "evaluation", "sort", "statistics" };
+
+/*-- One counter for this thread and every thread it starts from now on --*/
+static int open_counter( uint32_t type, uint64_t config ) {
+
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size           = sizeof(attr);
+  attr.type           = type;
+  attr.config         = config;
+  attr.inherit        = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv     = 1;
+
+  return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+perf_counters::perf_counters( int frequency, const char *file ) {
+
+  static const uint64_t config[PERF_EVENTS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+  };
+
+  memset(this->last, 0, sizeof(this->last));
+  memset(this->current, 0, sizeof(this->current));
+  memset(this->total, 0, sizeof(this->total));
+  this->frequency = frequency > 0 ? frequency : 1;
+  this->generations = 0;
+  this->out = stderr;
+
+  for ( int e=0; e<PERF_EVENTS; e++ ) {
+    if ( (this->fd[e] = open_counter(PERF_TYPE_HARDWARE, config[e])) < 0 ) {
+      perror("perf_event_open");
+      fprintf(stderr, "Hardware counters unavailable, carrying on without them\n");
+      for ( int i=0; i<e; i++ )
+	close(this->fd[i]);
+      for ( int i=0; i<PERF_EVENTS; i++ )
+	this->fd[i] = -1;
+      return;
+    }
+  }
+
+  if ( file && *file ) {
+    errno = 0;
+    if ( !(this->out = fopen(file, "w")) ) {
+      perror(file);
+      exit(errno);
+    }
+  }
+
+  fprintf(this->out, "#%-9s %10s %-10s %14s %14s %6s %12s %12s\n", "what", "generation", "phase",
+	  "cycles", "instructions", "ipc", "cache_miss", "branch_miss");
+
+  return;
+}
+
+perf_counters::~perf_counters( void ) {
+  for ( int e=0; e<PERF_EVENTS; e++ )
+    if ( this->fd[e] >= 0 )
+      close(this->fd[e]);
+  if ( this->out != stderr )
+    fclose(this->out);
+  return;
+}
+
+bool perf_counters::usable( void ) {
+  return this->fd[0] >= 0;
+}
+
+/*-- With inherit set a read sums the counter over the threads it was passed on to --*/
+void perf_counters::read_all( uint64_t *value ) {
+  for ( int e=0; e<PERF_EVENTS; e++ )
+    if ( read(this->fd[e], &value[e], sizeof(uint64_t)) != sizeof(uint64_t) )
+      value[e] = this->last[e];
+  return;
+}
+
+void perf_counters::start( void ) {
+  this->read_all(this->last);
+  return;
+}
+
+/*-- Charge everything counted since the last mark to phase p --*/
+void perf_counters::mark( perf_phase p ) {
+
+  uint64_t now[PERF_EVENTS];
+  this->read_all(now);
+
+  for ( int e=0; e<PERF_EVENTS; e++ ) {
+    this->current[p][e] += now[e] - this->last[e];
+    this->last[e] = now[e];
+  }
+
+  return;
+}
+
+void perf_counters::line( FILE *f, const char *what, unsigned int generation,
+			  uint64_t count[PERF_PHASES][PERF_EVENTS] ) {
+
+  for ( int p=0; p<PERF_PHASES; p++ ) {
+    uint64_t *c = count[p];
+    fprintf(f, "%-10s %10u %-10s %14lu %14lu %6.2f %12lu %12lu\n", what, generation, phase_names[p],
+	    (unsigned long)c[PERF_CYCLES], (unsigned long)c[PERF_INSTRUCTIONS],
+	    c[PERF_CYCLES] ? (double)c[PERF_INSTRUCTIONS]/c[PERF_CYCLES] : 0.0,
+	    (unsigned long)c[PERF_CACHE_MISSES], (unsigned long)c[PERF_BRANCH_MISSES]);
+  }
+
+  return;
+}
+
+void perf_counters::end_generation( unsigned int generation ) {
+
+  for ( int p=0; p<PERF_PHASES; p++ )
+    for ( int e=0; e<PERF_EVENTS; e++ )
+      this->total[p][e] += this->current[p][e];
+  this->generations++;
+
+  if ( !(this->generations % this->frequency) ) {
+    line(this->out, "gen", generation, this->current);
+    fflush(this->out);
+  }
+
+  memset(this->current, 0, sizeof(this->current));
+  return;
+}
+
+/*-- Per generation averages and rates over the whole run --*/
+void perf_counters::summary( FILE *f ) {
+
+  if ( !this->generations )
+    return;
+
+  fprintf(f, "\nHardware counters per generation, over %u generations:\n", this->generations);
+  fprintf(f, "  %-10s %14s %14s %6s %12s %12s %10s\n", "phase", "cycles", "instructions", "ipc",
+	  "cache_miss", "branch_miss", "miss/kinst");
+
+  for ( int p=0; p<PERF_PHASES; p++ ) {
+    uint64_t *c = this->total[p];
+    fprintf(f, "  %-10s %14.0f %14.0f %6.2f %12.0f %12.0f %10.2f\n", phase_names[p],
+	    (double)c[PERF_CYCLES]/this->generations,
+	    (double)c[PERF_INSTRUCTIONS]/this->generations,
+	    c[PERF_CYCLES] ? (double)c[PERF_INSTRUCTIONS]/c[PERF_CYCLES] : 0.0,
+	    (double)c[PERF_CACHE_MISSES]/this->generations,
+	    (double)c[PERF_BRANCH_MISSES]/this->generations,
+	    c[PERF_INSTRUCTIONS] ? 1000.0*c[PERF_CACHE_MISSES]/c[PERF_INSTRUCTIONS] : 0.0);
+  }
+
+  return;
+}
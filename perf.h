@@ -0,0 +1,82 @@
+#ifndef __PERF_H
+#define __PERF_H
+
+#include "global.h"
+
+#include <stdio.h>
+#include <stdint.h>
+
+using namespace std;
+
+/*-- The coarse phases hardware counters are charged to --*/
+enum perf_phase {
+  PERF_BREEDING = 0,      // roulette, selection, crossover and mutation
+  PERF_EVALUATION,        // fitness dispatch and wait (serial fitness lands in breeding)
+  PERF_SORT,              // elites and sort
+  PERF_STATISTICS,        // copy back and statistics
+  PERF_PHASES
+};
+
+enum perf_event {
+  PERF_CYCLES = 0,
+  PERF_INSTRUCTIONS,
+  PERF_CACHE_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_EVENTS
+};
+
+/*
+ * Cycles, instructions, cache misses and branch misses from
+ * perf_event_open(), charged to the phases above. The counters are opened
+ * with inherit set before the fitness thread pool starts, so the pool's
+ * threads are counted along with the main thread; remote workers are not.
+ * Every mark costs one read() per event, which is why the phases are
+ * coarser than the phase timers.
+ *
+ * PERF_COUNTERS = N in ga.rcp reports every Nth generation to PERF_FILE
+ * (stderr by default). If the kernel won't give us the counters (see
+ * /proc/sys/kernel/perf_event_paranoid) it says so once and carries on.
+ */
+class perf_counters {
+
+ public:
+  perf_counters( int, const char * );
+  ~perf_counters( void );
+
+  bool usable( void );
+  void start( void );
+  void mark( perf_phase );
+  void end_generation( unsigned int );
+  void summary( FILE * );
+
+ protected:
+
+ private:
+  void read_all( uint64_t * );
+  void line( FILE *, const char *, unsigned int, uint64_t [PERF_PHASES][PERF_EVENTS] );
+
+  int fd[PERF_EVENTS];
+  uint64_t last[PERF_EVENTS];
+  uint64_t current[PERF_PHASES][PERF_EVENTS];
+  uint64_t total[PERF_PHASES][PERF_EVENTS];
+
+  int frequency;
+  unsigned int generations;
+  FILE *out;
+};
+
+extern perf_counters *counters;
+
+inline void perf_start( void ) {
+  if ( counters )
+    counters->start();
+  return;
+}
+
+inline void perf_mark( perf_phase p ) {
+  if ( counters )
+    counters->mark(p);
+  return;
+}
+
+#endif
@@ -0,0 +1,93 @@
+#include "phases.h"
+
+#include <string.h>
+#include <errno.h>
+
+phase_timer *timing = NULL;
+
+const char *phase_timer::name( int p ) {
+  static const char *names[PHASE_COUNT] = {
+    "roulette", "selection", "breeding", "dispatch", "wait",
+    "elites", "sort", "copy", "statistics"
+  };
+  return names[p];
+}
+
+phase_timer::phase_timer( int frequency, const char *file ) {
+
+  memset(this->current, 0, sizeof(this->current));
+  memset(this->total, 0, sizeof(this->total));
+  this->frequency = frequency > 0 ? frequency : 1;
+  this->generations = 0;
+  this->out = stderr;
+
+  if ( file && *file ) {
+    errno = 0;
+    if ( !(this->out = fopen(file, "w")) ) {
+      perror(file);
+      exit(errno);
+    }
+  }
+
+  fprintf(this->out, "#%-9s %10s", "what", "generation");
+  for ( int p=0; p<PHASE_COUNT; p++ )
+    fprintf(this->out, " %10s", name(p));
+  fprintf(this->out, " %10s\n", "total_ms");
+
+  return;
+}
+
+phase_timer::~phase_timer( void ) {
+  if ( this->out != stderr )
+    fclose(this->out);
+  return;
+}
+
+/*-- One row of milliseconds, one column per phase --*/
+void phase_timer::line( FILE *f, const char *what, unsigned int generation, uint64_t *ns ) {
+
+  uint64_t sum = 0;
+  fprintf(f, "%-10s %10u", what, generation);
+  for ( int p=0; p<PHASE_COUNT; p++ ) {
+    fprintf(f, " %10.3f", 1e-6*ns[p]);
+    sum += ns[p];
+  }
+  fprintf(f, " %10.3f\n", 1e-6*sum);
+
+  return;
+}
+
+/*-- Fold this generation into the totals and report it if it's time --*/
+void phase_timer::end_generation( unsigned int generation ) {
+
+  for ( int p=0; p<PHASE_COUNT; p++ )
+    this->total[p] += this->current[p];
+  this->generations++;
+
+  if ( !(this->generations % this->frequency) ) {
+    line(this->out, "gen", generation, this->current);
+    line(this->out, "cumulative", generation, this->total);
+    fflush(this->out);
+  }
+
+  memset(this->current, 0, sizeof(this->current));
+  return;
+}
+
+/*-- Totals and each phase's share of them --*/
+void phase_timer::summary( FILE *f ) {
+
+  uint64_t sum = 0;
+  for ( int p=0; p<PHASE_COUNT; p++ )
+    sum += this->total[p];
+  if ( !sum || !this->generations )
+    return;
+
+  fprintf(f, "\nTime per phase over %u generations:\n", this->generations);
+  for ( int p=0; p<PHASE_COUNT; p++ )
+    fprintf(f, "  %-10s %12.3f ms %6.1f%%  %10.3f ms/gen\n", name(p),
+	    1e-6*this->total[p], 100.0*this->total[p]/sum,
+	    1e-6*this->total[p]/this->generations);
+
+  return;
+}
@@ -0,0 +1,79 @@
+#ifndef __PHASES_H
+#define __PHASES_H
+
+#include "global.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+using namespace std;
+
+/*-- The parts of a generation, in the order mate() goes through them --*/
+enum phase {
+  PHASE_ROULETTE = 0,     // roulette_fill()
+  PHASE_SELECTION,        // get_mate()
+  PHASE_BREEDING,         // make_baby(): crossover, mutation and serial fitness
+  PHASE_DISPATCH,         // handing the new population to threads or workers
+  PHASE_WAIT,             // waiting for their results
+  PHASE_ELITES,           // copy_elites()
+  PHASE_SORT,
+  PHASE_COPY,             // new population back into the old one
+  PHASE_STATISTICS,       // fittest, clones, average and deviation
+  PHASE_COUNT
+};
+
+/*
+ * Per phase wall clock time for each generation, from the monotonic clock.
+ * With PHASE_TIMING = N in ga.rcp every Nth generation's breakdown (and
+ * the running totals) is written to PHASE_FILE, or stderr if that isn't
+ * set, and the totals are printed once more on exit. With PHASE_TIMING
+ * unset the timers are a NULL test and nothing else.
+ */
+class phase_timer {
+
+ public:
+  phase_timer( int, const char * );
+  ~phase_timer( void );
+
+  void end_generation( unsigned int );
+  void summary( FILE * );
+
+  uint64_t current[PHASE_COUNT];
+  uint64_t total[PHASE_COUNT];
+
+  static const char *name( int );
+
+ protected:
+
+ private:
+  void line( FILE *, const char *, unsigned int, uint64_t * );
+
+  int frequency;
+  unsigned int generations;
+  FILE *out;
+};
+
+extern phase_timer *timing;
+
+inline uint64_t phase_now( void ) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+/*-- Start timing: returns the time, or 0 if timing is off --*/
+inline uint64_t phase_start( void ) {
+  return timing ? phase_now() : 0;
+}
+
+/*-- Charge everything since the last mark to p, and start the next phase now --*/
+inline uint64_t phase_mark( phase p, uint64_t since ) {
+  if ( !timing )
+    return 0;
+  uint64_t now = phase_now();
+  timing->current[p] += now - since;
+  return now;
+}
+
+#endif
@@ -0,0 +1,136 @@
+#include "plotter.h"
+
+plotter::plotter( void ) : bins( PLOT_BINS, 0.0, 0.25 ) {
+
+  this->gplot = new GnuPlot();
+  this->dropped = 0;
+  this->stopping = false;
+
+  pthread_mutex_init(&this->lock, NULL);
+  pthread_cond_init(&this->ready, NULL);
+
+  for ( int i=0; i<PLOT_QUEUE_DEPTH+1; i++ )
+    this->spare.push_back(new plot_frame);
+
+  if ( pthread_create(&this->tid, NULL, plotter::draw, this) ) {
+    perror("plotter: pthread_create");
+    exit(errno);
+  }
+
+  return;
+}
+
+plotter::~plotter( void ) {
+
+  this->finish();
+
+  while ( this->spare.size() ) {
+    delete this->spare.back();
+    this->spare.pop_back();
+  }
+
+  pthread_cond_destroy(&this->ready);
+  pthread_mutex_destroy(&this->lock);
+  delete this->gplot;
+  return;
+}
+
+/*-- Queue a snapshot of the population, dropping the stalest frame if gnuplot is behind --*/
+void plotter::submit( population *society ) {
+
+  pthread_mutex_lock(&this->lock);
+  plot_frame *frame;
+  if ( this->queue.size() >= PLOT_QUEUE_DEPTH ) {
+    frame = this->queue.front();
+    this->queue.pop_front();
+    this->dropped++;
+  } else {
+    frame = this->spare.back();
+    this->spare.pop_back();
+  }
+  pthread_mutex_unlock(&this->lock);
+
+  // Fill it outside the lock, the drawing thread never sees it until it's queued
+  frame->generation = society->generation;
+  frame->average = society->average;
+  frame->stdev = society->stdev;
+  frame->fitness.resize(society->last->count);
+
+  int n = 0;
+  for ( individual *p = society->first; p; p = p->next )
+    frame->fitness[n++] = p->fitness;
+
+  pthread_mutex_lock(&this->lock);
+  this->queue.push_back(frame);
+  pthread_cond_signal(&this->ready);
+  pthread_mutex_unlock(&this->lock);
+
+  return;
+}
+
+/*-- Draw whatever is still queued, then stop the thread --*/
+void plotter::finish( void ) {
+
+  pthread_mutex_lock(&this->lock);
+  if ( this->stopping ) {
+    pthread_mutex_unlock(&this->lock);
+    return;
+  }
+  this->stopping = true;
+  pthread_cond_signal(&this->ready);
+  pthread_mutex_unlock(&this->lock);
+
+  pthread_join(this->tid, NULL);
+
+  if ( this->dropped && params->VERBOSE )
+    log_printf("Plotting skipped %lu frames to keep up\n", this->dropped);
+  return;
+}
+
+void plotter::render( plot_frame *frame ) {
+
+  char range[128];
+
+  this->gplot->gnuplot_resetplot();
+
+  sprintf(range, "set xrange [%f:%f];set yrange[0:50]",
+	  params->EXIT_LIMIT, frame->average + frame->stdev);
+  this->gplot->gnuplot_cmd(range);
+
+  double plot_max = frame->average + 2*frame->stdev;
+  if ( plot_max < 0.25 )
+    plot_max = 0.25;
+
+  // Big populations are binned by as many threads as evaluate fitness
+  this->bins.range(0.0, plot_max);
+  this->bins.add(&frame->fitness[0], frame->fitness.size(),
+		 params->NUM_THREADS > 0 ? params->NUM_THREADS : 1);
+
+  this->gplot->gnuplot_plot_histogram( this->bins, (char *)"Population Fitness" );
+  return;
+}
+
+void *plotter::draw( void *arg ) {
+  plotter *self = (plotter *)arg;
+
+  pthread_mutex_lock(&self->lock);
+  while ( true ) {
+    while ( self->queue.empty() && !self->stopping )
+      pthread_cond_wait(&self->ready, &self->lock);
+
+    if ( self->queue.empty() )
+      break;
+
+    plot_frame *frame = self->queue.front();
+    self->queue.pop_front();
+    pthread_mutex_unlock(&self->lock);
+
+    self->render(frame);
+
+    pthread_mutex_lock(&self->lock);
+    self->spare.push_back(frame);
+  }
+  pthread_mutex_unlock(&self->lock);
+
+  return NULL;
+}
@@ -0,0 +1,62 @@
+#ifndef __PLOTTER_H
+#define __PLOTTER_H
+
+#include "global.h"
+#include "population.h"
+#include "gnuplot.h"
+#include "histogram.h"
+
+#include <pthread.h>
+#include <vector>
+#include <deque>
+
+using namespace std;
+
+/*-- Frames waiting to be drawn; when full the oldest is thrown away --*/
+#define PLOT_QUEUE_DEPTH  2
+#define PLOT_BINS         100
+
+/*-- What a plot needs from one generation --*/
+typedef struct {
+  unsigned int generation;
+  double average;
+  double stdev;
+  vector<double> fitness;
+} plot_frame;
+
+/*
+ * Live plotting off the generation loop. submit() copies the fitness
+ * values into a recycled frame and queues it for a background thread,
+ * which owns the gnuplot session. If gnuplot falls behind, frames that
+ * haven't been drawn yet are dropped in favour of newer ones, so the
+ * window shows the latest generation and evolution never waits on it.
+ */
+class plotter {
+
+ public:
+  plotter( void );
+  ~plotter( void );
+
+  void submit( population * );
+  void finish( void );
+
+ protected:
+
+ private:
+  static void *draw( void * );
+  void render( plot_frame * );
+
+  GnuPlot *gplot;
+  histogram bins;
+
+  deque<plot_frame *> queue;
+  vector<plot_frame *> spare;
+  unsigned long dropped;
+  bool stopping;
+
+  pthread_t tid;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+};
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef __PLUGIN_H
+#define __PLUGIN_H
+
+#include "global.h"
+#include "individual.h"
+
+/*
+ * Fitness plugins: a shared object named by FITNESS_PLUGIN in ga.rcp,
+ * loaded with dlopen() in place of the built in fitness functions. It
+ * exports one C symbol, ga_plugin_entry, that returns a ga_plugin
+ * describing itself:
+ *
+ *   abi_version      GA_PLUGIN_ABI_VERSION it was built against
+ *   individual_size  sizeof(individual) and GENE_FORMAT it was built
+ *   gene_format      with, so a plugin from another GENE_TYPE is refused
+ *   capabilities     GA_PLUGIN_* flags below
+ *
+ *   init             once, before anything else; non zero if it can't run
+ *                    here (a SIMD build on a CPU without the instructions,
+ *                    say), which isn't fatal if there are other variants
+ *   thread_init      once in each thread, before its first evaluate; NULL
+ *                    if there's nothing to set up
+ *   evaluate         fills in fitness (and objective[], bounded) for n
+ *                    individuals; n is 1 unless it claims GA_PLUGIN_BATCH,
+ *                    when it's a batch, or with a pool a contiguous slice
+ *                    of one per pool thread
+ *   output           prints an individual's solution, for the final report
+ *   teardown         once, at exit; may be NULL. Waits for any evaluate()
+ *                    still running, and none are made after it
+ *
+ * The individuals are the ga's own, so the usual fields apply: gene[],
+ * nGenes, cutoff, and the fitness, bounded and objective[] it sets.
+ * Genes are read with gene_value(), which in a fixed point build turns
+ * the stored integer back into the value; fixed point builds have no
+ * other way to evaluate, the built in functions refuse them.
+ *
+ * This isn't a C ABI: evaluate() is handed the C++ class individual as
+ * laid out by this build, and the context a parameters *, both used in
+ * place. Nothing checks that beyond individual_size and gene_format
+ * above, so a plugin has to be built from the same headers, with the
+ * same compiler and flags, as the ga that loads it; a change to either
+ * class that leaves sizeof(individual) alone goes unnoticed.
+ */
+#define GA_PLUGIN_ABI_VERSION 1
+#define GA_PLUGIN_ENTRY "ga_plugin_entry"
+
+#define GA_PLUGIN_BATCH       0x1   // evaluate() wants whole generations at once
+#define GA_PLUGIN_SIMD        0x2   // vectorized across individuals, implies it prefers batches
+#define GA_PLUGIN_THREAD_SAFE 0x4   // evaluate() may run in several threads at once
+#define GA_PLUGIN_OBJECTIVES  0x8   // evaluate() fills objective[0..OBJECTIVES) too, for NSGA-II
+
+typedef struct {
+  parameters *params;               // ga.rcp, for settings of the plugin's own
+  int genes;
+  int objectives;
+  unsigned int threads;             // pool threads evaluate() may be called from, 0 for the caller's only
+} ga_plugin_context;
+
+typedef struct {
+  unsigned int abi_version;
+  const char *name;
+  unsigned int capabilities;
+  size_t individual_size;
+  unsigned int gene_format;
+
+  int  (*init)( const ga_plugin_context * );
+  void (*thread_init)( void );
+  void (*evaluate)( individual **, unsigned int );
+  void (*output)( individual * );
+  void (*teardown)( void );
+} ga_plugin;
+
+extern "C" {
+  typedef const ga_plugin *(*ga_plugin_entry_fn)( void );
+  const ga_plugin *ga_plugin_entry( void );
+}
+
+#endif
@@ -0,0 +1,360 @@
+#include "popfile.h"
+#include "population.h"
+#include "checkpoint.h"
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static uint64_t align( uint64_t offset ) {
+  return (offset + POPFILE_ALIGN - 1) & ~(uint64_t)(POPFILE_ALIGN - 1);
+}
+
+/*-- Whether n items of size bytes at offset lie inside the file, without overflowing on a bad header --*/
+static bool inside( uint64_t offset, uint64_t n, uint64_t size, uint64_t bytes ) {
+  return offset <= bytes && n <= (bytes - offset)/size;
+}
+
+/*-- Open a population file, a checkpoint or a text dump, whichever this turns out to be --*/
+popfile::popfile( const char *file ) {
+
+  this->filename = new char [strlen(file)+1];
+  strcpy(this->filename, file);
+  this->map   = NULL;
+  this->bytes = 0;
+  this->base  = NULL;
+  this->flags = NULL;
+  memset(&this->header, 0, sizeof(this->header));
+
+  this->map_file();
+
+  if ( this->bytes >= sizeof(popfile_header) &&
+       !strncmp((char *)this->map, POPFILE_MAGIC, sizeof(this->header.magic)) )
+    this->from_popfile();
+  else if ( this->bytes >= sizeof(checkpoint_header) &&
+	    !strncmp((char *)this->map, CHECKPOINT_MAGIC, sizeof(this->header.magic)) )
+    this->from_checkpoint();
+  else
+    this->from_dump();
+
+  popfile_header *h = &this->header;
+  if ( !h->gene_format )
+    h->gene_format = GENE_FORMAT_LEGACY;
+
+  if ( h->gene_format != GENE_FORMAT || h->gene_bytes != sizeof(gene_t) ) {
+    fprintf(stderr, "%s: genes are format %#x, this build uses %#x\n",
+	    file, h->gene_format, GENE_FORMAT);
+    exit(EINVAL);
+  }
+
+#ifdef GENE_FIXED
+  if ( h->gene_quantum != gene_quantum ) {
+    fprintf(stderr, "%s: fixed point genes in steps of %g, ACCURACY gives %g\n",
+	    file, h->gene_quantum, gene_quantum);
+    exit(EINVAL);
+  }
+#endif
+
+  if ( this->base == this->map &&
+       ( ((h->flags & POPFILE_HAS_BOUNDS) && !inside(h->bounds_offset, 2*(uint64_t)h->nGenes, sizeof(double), this->bytes)) ||
+	 !inside(h->fitness_offset, h->count, sizeof(float), this->bytes) ||
+	 !h->nGenes || !inside(h->gene_offset, h->count, h->nGenes*sizeof(gene_t), this->bytes) ) ) {
+    fprintf(stderr, "%s: truncated population file\n", file);
+    exit(EINVAL);
+  }
+
+  /*-- We'll be walking the gene matrix front to back --*/
+  if ( this->base == this->map )
+    madvise((char *)this->map + (h->gene_offset & ~(uint64_t)(POPFILE_ALIGN-1)),
+	    h->count*h->nGenes*sizeof(gene_t), MADV_SEQUENTIAL);
+
+  return;
+}
+
+popfile::~popfile( void ) {
+  if ( this->map )
+    munmap(this->map, this->bytes);
+  delete [] this->filename;
+  return;
+}
+
+void popfile::map_file( void ) {
+
+  errno = 0;
+  int fd = open(this->filename, O_RDONLY);
+  if ( fd < 0 ) {
+    perror(this->filename);
+    exit(errno);
+  }
+
+  struct stat st;
+  if ( fstat(fd, &st) ) {
+    perror(this->filename);
+    exit(errno);
+  }
+  this->bytes = st.st_size;
+
+  if ( !this->bytes ) {
+    fprintf(stderr, "%s: empty population file\n", this->filename);
+    exit(EINVAL);
+  }
+
+  this->map = mmap(NULL, this->bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if ( this->map == MAP_FAILED ) {
+    perror(this->filename);
+    exit(errno);
+  }
+
+  return;
+}
+
+void popfile::from_popfile( void ) {
+
+  memcpy(&this->header, this->map, sizeof(this->header));
+  this->base = (char *)this->map;
+
+  if ( this->header.version != POPFILE_VERSION ) {
+    fprintf(stderr, "%s: not a version %i population file\n", this->filename, POPFILE_VERSION);
+    exit(EINVAL);
+  }
+
+  return;
+}
+
+/*-- Checkpoint genes are one contiguous matrix too, so they map just as well --*/
+void popfile::from_checkpoint( void ) {
+
+  checkpoint_header *ck = (checkpoint_header *)this->map;
+
+  if ( ck->version != CHECKPOINT_VERSION ) {
+    fprintf(stderr, "%s: not a version %i checkpoint\n", this->filename, CHECKPOINT_VERSION);
+    exit(EINVAL);
+  }
+
+  /* Everything past the header is used as it lies, so it has to be the
+   * checkpoint that was written: the size its header implies, worked out
+   * by division so a bad count can't overflow it, and the checksum */
+  uint64_t record = 2*sizeof(float) + sizeof(int32_t) + sizeof(uint32_t) + (uint64_t)ck->nGenes*sizeof(gene_t);
+  uint64_t body = this->bytes - sizeof(checkpoint_header) - sizeof(uint32_t);
+  uint32_t checksum = 0;
+  if ( this->bytes >= sizeof(checkpoint_header) + sizeof(uint32_t) )
+    memcpy(&checksum, (char *)this->map + this->bytes - sizeof(uint32_t), sizeof(uint32_t));
+
+  if ( this->bytes < sizeof(checkpoint_header) + sizeof(uint32_t) ||
+       body % record || body/record != (uint64_t)ck->count + ck->scratch_count ||
+       checksum != checkpoint_checksum((const char *)this->map, this->bytes - sizeof(uint32_t)) ) {
+    fprintf(stderr, "%s: checkpoint is truncated or corrupt (checksum doesn't match), not using it\n", this->filename);
+    exit(EINVAL);
+  }
+
+  popfile_header *h = &this->header;
+  strncpy(h->magic, POPFILE_MAGIC, sizeof(h->magic));
+  h->version         = POPFILE_VERSION;
+  h->flags           = POPFILE_HAS_FITNESS;
+  h->count           = ck->count;
+  h->nGenes          = ck->nGenes;
+  h->gene_bytes      = sizeof(gene_t);
+  h->gene_format     = ck->gene_format;
+  h->gene_quantum    = gene_quantum;
+  h->fitness_offset  = sizeof(checkpoint_header);
+  h->gene_offset     = h->fitness_offset + h->count*(2*sizeof(float) + sizeof(int32_t) + sizeof(uint32_t));
+  h->fitness_version = ck->fitness_version;
+  h->generation      = ck->generation;
+
+  this->base = (char *)this->map;
+  this->flags = (const uint32_t *)(this->base + h->gene_offset) - h->count;
+  return;
+}
+
+/*-- Parse the "NNN ( g1, g2, ... ) => fitness = f" lines population::dump() prints --*/
+void popfile::from_dump( void ) {
+
+  const char *p   = (const char *)this->map;
+  const char *end = p + this->bytes;
+  int nGenes = params->NUMBER_OF_GENES;
+  uint64_t count = 0;
+
+  vector<gene_t> genes;
+  vector<float> fitness;
+  vector<gene_t> row(nGenes);
+
+  while ( p < end ) {
+    const char *eol = (const char *)memchr(p, '\n', end - p);
+    if ( !eol )
+      eol = end;
+
+    string line(p, eol - p);
+    p = eol + 1;
+
+    size_t open  = line.find('(');
+    size_t close = line.find(')');
+    size_t fit   = line.find("fitness =");
+    if ( open == string::npos || close == string::npos || fit == string::npos || close < open )
+      continue;
+
+    const char *q = line.c_str() + open + 1;
+    const char *stop = line.c_str() + close;
+    int n = 0;
+    while ( q < stop && n <= nGenes ) {
+      char *next;
+      double value = strtod(q, &next);
+      if ( next == q ) {
+	q++;                      // separators, and the backspace dump() leaves behind
+	continue;
+      }
+      if ( n < nGenes )
+	row[n] = gene_store(value);
+      n++;
+      q = next;
+    }
+
+    if ( n != nGenes )
+      continue;
+
+    genes.insert(genes.end(), row.begin(), row.end());
+    fitness.push_back(strtod(line.c_str() + fit + 9, NULL));
+    count++;
+  }
+
+  if ( !count ) {
+    fprintf(stderr, "%s: no %i gene individuals found\n", this->filename, nGenes);
+    exit(EINVAL);
+  }
+
+  /*-- The dump is all in memory now, so the mapping can go --*/
+  munmap(this->map, this->bytes);
+  this->map = NULL;
+
+  size_t fitness_bytes = (count*sizeof(float) + sizeof(double) - 1) & ~(sizeof(double) - 1);
+  this->text.resize(fitness_bytes + genes.size()*sizeof(gene_t));
+  memcpy(&this->text[0], &fitness[0], fitness_bytes);
+  memcpy(&this->text[fitness_bytes], &genes[0], genes.size()*sizeof(gene_t));
+
+  popfile_header *h = &this->header;
+  strncpy(h->magic, POPFILE_MAGIC, sizeof(h->magic));
+  h->version         = POPFILE_VERSION;
+  // A dump says nothing of which fitness function it came from, and is rounded to ACCURACY
+  h->flags           = 0;
+  h->count           = count;
+  h->nGenes          = nGenes;
+  h->gene_bytes      = sizeof(gene_t);
+  h->gene_format     = GENE_FORMAT;
+  h->gene_quantum    = gene_quantum;
+  h->fitness_offset  = 0;
+  h->gene_offset     = fitness_bytes;
+  h->fitness_version = 0;
+
+  this->base = (char *)&this->text[0];
+  this->bytes = 0;
+
+  return;
+}
+
+uint64_t popfile::get_count( void ) { return this->header.count; }
+
+int popfile::get_genes( void ) { return this->header.nGenes; }
+
+bool popfile::has_fitness( void ) { return this->header.flags & POPFILE_HAS_FITNESS; }
+
+uint32_t popfile::get_fitness_version( void ) { return this->header.fitness_version; }
+
+gene_t *popfile::gene( uint64_t which ) {
+  return (gene_t *)(this->base + this->header.gene_offset) + which*this->header.nGenes;
+}
+
+float popfile::fitness( uint64_t which ) {
+  return ((float *)(this->base + this->header.fitness_offset))[which];
+}
+
+/*-- A complete evaluation, rather than a prediction, a lower bound or a NaN written in place of either --*/
+bool popfile::exact( uint64_t which ) {
+  if ( this->flags && (this->flags[which] & (CHECKPOINT_ESTIMATED | CHECKPOINT_BOUNDED)) )
+    return false;
+  return !isnan(this->fitness(which));
+}
+
+double *popfile::lower( void ) {
+  if ( !(this->header.flags & POPFILE_HAS_BOUNDS) )
+    return NULL;
+  return (double *)(this->base + this->header.bounds_offset);
+}
+
+double *popfile::upper( void ) {
+  if ( !(this->header.flags & POPFILE_HAS_BOUNDS) )
+    return NULL;
+  return this->lower() + this->header.nGenes;
+}
+
+/*-- Export a population, with the current gene bounds, through a temp file and rename --*/
+bool popfile::write( const char *file, population *society, uint32_t fitness_version ) {
+
+  if ( !fitness_version )
+    fitness_version = params->FITNESS_VERSION;
+
+  popfile_header h;
+  memset(&h, 0, sizeof(h));
+  strncpy(h.magic, POPFILE_MAGIC, sizeof(h.magic));
+
+  h.version         = POPFILE_VERSION;
+  h.flags           = POPFILE_HAS_FITNESS | POPFILE_HAS_BOUNDS;
+  h.count           = society->last->count;
+  h.nGenes          = params->NUMBER_OF_GENES;
+  h.gene_bytes      = sizeof(gene_t);
+  h.gene_format     = GENE_FORMAT;
+  h.gene_quantum    = gene_quantum;
+  h.bounds_offset   = align(sizeof(h));
+  h.fitness_offset  = align(h.bounds_offset + 2*h.nGenes*sizeof(double));
+  h.gene_offset     = align(h.fitness_offset + h.count*sizeof(float));
+  h.fitness_version = fitness_version;
+  h.generation      = society->generation;
+
+  char tmpname[strlen(file) + 8];
+  sprintf(tmpname, "%s.tmp", file);
+
+  FILE *pFile = fopen(tmpname, "w");
+  if ( !pFile ) {
+    perror(tmpname);
+    return false;
+  }
+
+  static const char zeros[POPFILE_ALIGN] = { 0 };
+  bool ok = fwrite(&h, sizeof(h), 1, pFile) == 1;
+
+  ok = ok && fwrite(zeros, 1, h.bounds_offset - sizeof(h), pFile) == h.bounds_offset - sizeof(h);
+  ok = ok && fwrite(params->pLO, sizeof(double), h.nGenes, pFile) == h.nGenes;
+  ok = ok && fwrite(params->pHI, sizeof(double), h.nGenes, pFile) == h.nGenes;
+
+  long pad = h.fitness_offset - ftell(pFile);
+  ok = ok && fwrite(zeros, 1, pad, pFile) == (size_t)pad;
+
+  // Only complete evaluations go in the fitness column; a prediction or a lower bound is written as NaN
+  individual *person = society->first;
+  while ( ok && person ) {
+    float fitness = ( person->estimated || person->bounded ) ? NAN : person->fitness;
+    ok = fwrite(&fitness, sizeof(float), 1, pFile) == 1;
+    person = person->next;
+  }
+
+  pad = h.gene_offset - ftell(pFile);
+  ok = ok && fwrite(zeros, 1, pad, pFile) == (size_t)pad;
+
+  person = society->first;
+  while ( ok && person ) {
+    ok = fwrite(person->gene, sizeof(gene_t), h.nGenes, pFile) == h.nGenes;
+    person = person->next;
+  }
+
+  ok = ok && !fflush(pFile) && !fsync(fileno(pFile));
+  ok = !fclose(pFile) && ok;
+
+  if ( !ok || rename(tmpname, file) ) {
+    perror(file);
+    unlink(tmpname);
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,100 @@
+#ifndef __POPFILE_H
+#define __POPFILE_H
+
+#include "global.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+using namespace std;
+
+#define POPFILE_MAGIC     "GAPOP"
+#define POPFILE_VERSION   1
+#define POPFILE_ALIGN     4096
+
+/*-- popfile_header.flags --*/
+#define POPFILE_HAS_FITNESS  0x1    // fitness column holds real evaluations, NaN where it doesn't
+#define POPFILE_HAS_BOUNDS   0x2    // bounds block is present
+
+/*
+ * Memory mappable population file, host byte order. Every block starts
+ * on a POPFILE_ALIGN boundary so the gene matrix can be used in place:
+ *
+ *   popfile_header
+ *   double lower[nGenes], upper[nGenes]     at bounds_offset
+ *   float  fitness[count]                   at fitness_offset
+ *   gene_t gene[count][nGenes]              at gene_offset
+ *
+ * gene_format is the GENE_FORMAT of the build that wrote the file (0 in
+ * files from before there was a choice, meaning float), and gene_quantum
+ * the fixed point step if it was a fixed point build.
+ */
+typedef struct {
+  char     magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t count;
+  uint32_t nGenes;
+  uint32_t gene_bytes;
+  uint64_t bounds_offset;
+  uint64_t fitness_offset;
+  uint64_t gene_offset;
+  uint32_t fitness_version;
+  uint32_t generation;
+  uint32_t gene_format;
+  uint32_t pad;
+  double   gene_quantum;
+  char     reserved[176];
+} popfile_header;
+
+class population;
+
+/*
+ * A read-only view of a population file. The mapping is private, so
+ * individuals built on top of it can be bred into without touching the
+ * file; only the pages actually written get copied. The popfile has to
+ * outlive any population constructed from it.
+ *
+ * Checkpoints are mapped the same way, and the text written by
+ * population::dump() is parsed into memory, so any of the three can seed
+ * a run. For those the header is made up to describe them.
+ */
+class popfile {
+
+ public:
+  popfile( const char * );
+  ~popfile( void );
+
+  uint64_t get_count( void );
+  int      get_genes( void );
+  bool     has_fitness( void );
+  uint32_t get_fitness_version( void );
+
+  gene_t *gene( uint64_t );
+  float   fitness( uint64_t );
+  bool    exact( uint64_t );
+  double *lower( void );
+  double *upper( void );
+
+  popfile_header header;
+
+  static bool write( const char *, population *, uint32_t = 0 );
+
+ protected:
+
+ private:
+  void map_file( void );
+  void from_popfile( void );
+  void from_checkpoint( void );
+  void from_dump( void );
+
+  char  *filename;
+  void  *map;
+  size_t bytes;
+  char  *base;
+  const uint32_t *flags;            // a checkpoint's per individual CHECKPOINT_* flags, else NULL
+  vector<char> text;
+};
+
+#endif
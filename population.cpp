@@ -3,29 +3,158 @@
 /*-- We'll need a temporary population --*/
 static population *newPopulation;
 
-/*-- Base constructor. Creates a new population with randomly filled individuals --*/
-population::population( void ) {
+/*-- Base constructor. Creates a new population with randomly filled (or empty) individuals --*/
+population::population( bool initialize ) {
 
-  this->first = new individual( &this->first, true, true );
+  this->first = new individual( &this->first, initialize, true );
   person = this->first;
 
   for (int i=1; i<params->INITIAL_POPULATION; i++)
-    person = new individual( &person );
+    person = new individual( &person, initialize );
 
   this->last = person;
   this->recount();
-  
+
+  // Threaded or remote evaluations have to land before anyone looks at them
+  if ( initialize && params->ASYNC_FITNESS )
+    wait_for_threads();
+
+  this->setup();
+
+  return;
+}
+
+/*
+ * Build a population on top of a mapped population file. The individuals
+ * use the file's gene matrix in place, without copying it. Anything short
+ * of params->INITIAL_POPULATION is filled with random individuals.
+ */
+population::population( popfile *source ) {
+
+  if ( source->get_genes() != params->NUMBER_OF_GENES ) {
+    fprintf(stderr, "Population file has %i genes, expected %i\n",
+	    source->get_genes(), params->NUMBER_OF_GENES);
+    exit(EINVAL);
+  }
+
+  /*-- SEED_FRACTION of the initial population comes from the file, the rest is filled in --*/
+  uint64_t n = source->get_count();
+  if ( params->INITIAL_POPULATION > 0 ) {
+    float fraction = params->SEED_FRACTION;
+    if ( fraction <= 0.0f || fraction > 1.0f )
+      fraction = 1.0f;
+    uint64_t wanted = (uint64_t)(fraction*params->INITIAL_POPULATION + 0.5f);
+    if ( n > wanted )
+      n = wanted;
+  }
+
+  if ( !n ) {
+    fprintf(stderr, "Population file is empty\n");
+    exit(EINVAL);
+  }
+
+  /*-- Stored fitness is only trusted if it came from the same fitness function --*/
+  bool evaluate = !source->has_fitness() ||
+    source->get_fitness_version() != params->FITNESS_VERSION;
+
+  if ( evaluate && params->VERBOSE )
+    fprintf(stderr, "Re-evaluating %lu seeded individuals\n", (unsigned long)n);
+
+  this->first = new individual( &this->first, source->gene(0), source->fitness(0), true );
+  person = this->first;
+  for ( uint64_t i=1; i<n; i++ )
+    person = new individual( &person, source->gene(i), source->fitness(i) );
+
+  /* The bounds may have moved since the file was written. Pull stray genes
+   * back inside (mutate() would otherwise never get them out) and have
+   * those individuals evaluated again, along with any whose stored fitness
+   * was never an evaluation. A NaN gene is nowhere, it goes to the lower
+   * limit. */
+  uint64_t which = 0;
+  for ( individual *p = this->first; p; p = p->next, which++ ) {
+    bool moved = false;
+    for ( int i=0; i<params->NUMBER_OF_GENES; i++ ) {
+      if ( !(gene_value(p->gene[i]) >= params->pLO[i]) ) {
+	p->gene[i] = gene_store(params->pLO[i]);
+	moved = true;
+      } else if ( gene_value(p->gene[i]) > params->pHI[i] ) {
+	p->gene[i] = gene_store(params->pHI[i]);
+	moved = true;
+      }
+    }
+    if ( evaluate || moved || !source->exact(which) )
+      p->testFitness();
+  }
+
+  bool quasi = params->SEED_FILL && !strcmp(params->SEED_FILL, "QUASI");
+  for ( int i=n; i<params->INITIAL_POPULATION; i++ ) {
+    if ( quasi ) {
+      person = new individual( &person, false );
+      this->quasi_genes(person, i - n + 1);
+      person->testFitness();
+    } else
+      person = new individual( &person );
+  }
+
+  this->last = person;
+  this->recount();
+
+  if ( params->ASYNC_FITNESS )
+    wait_for_threads();
+
+  this->setup();
+  this->sort();
+
+  return;
+}
+
+/*
+ * Low discrepancy fill for the part of a warm start that isn't seeded:
+ * the additive recurrence x = frac(0.5 + n*alpha) with alpha_i = 1/phi^(i+1),
+ * phi being the positive root of x^(d+1) = x + 1. Spreads the newcomers
+ * evenly over the box instead of leaving gaps next to the seeded ones.
+ */
+void population::quasi_genes( individual *baby, int n ) {
+
+  static double phi = 0.0;
+  int d = params->NUMBER_OF_GENES;
+
+  if ( phi == 0.0 ) {
+    phi = 2.0;
+    for ( int i=0; i<64; i++ )
+      phi = pow(1.0 + phi, 1.0/(d + 1.0));
+  }
+
+  double alpha = 1.0;
+  for ( int i=0; i<d; i++ ) {
+    alpha /= phi;
+    double x = 0.5 + n*alpha;
+    x -= floor(x);
+    baby->gene[i] = gene_store(params->pLO[i] + x*(params->pHI[i] - params->pLO[i]));
+  }
+
+  return;
+}
+
+/*-- Bookkeeping common to all the constructors --*/
+void population::setup( void ) {
+
   this->get_fittest();
 
-  this->allocation = params->INITIAL_POPULATION;
+  this->allocation = this->last->count;
   this->fitness_array = new double [this->allocation];
 
   this->generation = 0;
   this->clones = 0;
+  this->bounded = 0;
+  this->estimated = 0;
+  this->worst = INFINITY;
   this->average = 0.0f;
   this->stdev = 0.0f;
   this->variation = 0.0f;
+  this->mutation_rate = params->MUTATION_RATE;
   this->mating_in_progress = false;
+  this->screen = NULL;
 
   return;
 }
@@ -41,6 +170,8 @@ population::~population( void ) {
 
   if ( allocation && fitness_array )
     delete [] fitness_array;
+  if ( this->screen )
+    delete this->screen;
 
   this->person = this->first->next;
   delete first;
@@ -114,16 +245,28 @@ void population::roulette_fill( void ) {
       person = person->next;
     }
     if ( params->VERBOSE == 3 )
-      printf("No spread... everyone gets a baby\n");
+      log_str("No spread... everyone gets a baby\n");
     return;
   }
 
   float population_control = 5*params->INITIAL_POPULATION/(this->last->count);
 
+  // Bounded individuals have no share, so theirs goes to the rest rather than the population shrinking
+  float share = 1.0f;
+  if ( this->bounded > 0 && this->bounded < (unsigned int)this->last->count )
+    share = (float)this->last->count / (this->last->count - this->bounded);
+
   while ( person ) {
+    if ( person->bounded ) {
+      person->progeny = 0;
+      person = person->next;
+      continue;
+    }
+
     float fitness = params->MAX_FITNESS - person->fitness;
-    unsigned int number_of_copies = (unsigned int)(fitness/average_fitness);
-    float chance = (fitness/average_fitness) - (int)(fitness/average_fitness);
+    float copies = share*fitness/average_fitness;
+    unsigned int number_of_copies = (unsigned int)copies;
+    float chance = copies - (int)copies;
 
     person->progeny = number_of_copies;
     if ( params->KEEP_STABLE_POPULATION ) {
@@ -133,8 +276,13 @@ void population::roulette_fill( void ) {
       if ( randf() < chance*population_control )
 	person->progeny++;
     }
-    if ( params->VERBOSE == 3 )
-      printf("Individual %i has %i progeny\n", person->count, person->progeny);
+    if ( params->VERBOSE == 3 ) {
+      log_str("Individual ");
+      log_int(person->count);
+      log_str(" has ");
+      log_int(person->progeny);
+      log_str(" progeny\n");
+    }
 
     person = person->next;
   }
@@ -149,23 +297,36 @@ void population::mate( void ) {
 
   // Raise the mating flag.... Ahoy maties :P
   this->mating_in_progress = true;
+  uint64_t t = phase_start();
+  uint64_t span = trace_begin(), started = span;
+  perf_start();
 
   /*-- Declare the internal variables we'll need to do our job --*/
   int newCount = 0;
 
   if ( params->VERBOSE == 3 ) {
-    printf("/================ mating population ===================/\n");
+    log_str("/================ mating population ===================/\n");
     this->dump();
-    printf("/======================================================/\n");
+    log_str("/======================================================/\n");
   }
 
-  if ( !newPopulation )
-    newPopulation = new population();
+  this->scratch( true );
+
+  // The surrogate starts from whoever has been evaluated by the first time it's needed
+  if ( params->SURROGATE && !this->screen )
+    this->screen = new surrogate( this );
 
   newPopulation->mating_in_progress = true;
 
   // Figure out how many kids each individual can have
   this->roulette_fill();
+  t = phase_mark(PHASE_ROULETTE, t);
+  span = trace_mark("roulette", span);
+
+  /* A child worse than every parent that's been selected from is where
+   * evaluating it can stop: it would be bounded and have no share of the
+   * next roulette, and past MAX_FITNESS it has none anyway */
+  float cutoff = ( this->worst < params->MAX_FITNESS ) ? this->worst : params->MAX_FITNESS;
 
   /*-- New individuals are poked onto the new population --*/
   baby = newPopulation->first;
@@ -205,6 +366,7 @@ void population::mate( void ) {
 	fprintf(stderr,"\nCloning!\nMating %i,%f with %i,%f\n",
 	     daddy->count, daddy->fitness, mommy->count, mommy->fitness);
     }
+    t = phase_mark(PHASE_SELECTION, t);
 
     if ( params->VERBOSE == 3 ) {
       daddy->output(true);
@@ -216,12 +378,20 @@ void population::mate( void ) {
 	break;
 
       if ( params->VERBOSE == 3 )
-	printf("Adding brand new baby\n");
+	log_str("Adding brand new baby\n");
 
-      baby = newPopulation->push(daddy->make_baby( mommy ));
+      baby = newPopulation->push(daddy->make_baby( mommy, !this->screen, cutoff ));
 
     } else
-      baby->copy( daddy->make_baby( mommy ) );
+      baby->copy( daddy->make_baby( mommy, !this->screen, cutoff ) );
+
+    // Only the promising ones go on to be evaluated, and pipelined they go straight away
+    bool wanted = this->screen ? this->screen->screen( baby, daddy, mommy ) : true;
+    if ( wanted && this->screen && !params->ASYNC_FITNESS )
+      baby->testFitness();
+    else if ( wanted && params->ASYNC_FITNESS && params->PIPELINE )
+      getFitness((void *)baby);
+    t = phase_mark(PHASE_BREEDING, t);
 
     if ( params->VERBOSE == 3 )
       baby->output(true);
@@ -237,17 +407,38 @@ void population::mate( void ) {
       break;
   }
 
-  // Get the fitness of each member of the population
-  if ( params->NUM_THREADS ) {
-    lock();
-    baby = newPopulation->first;
-    while ( baby ) {
-      getFitness((void *)baby);
-      baby = baby->next;
+  perf_mark(PERF_BREEDING);
+  span = trace_mark("breeding", span);
+
+  // Get the fitness of each member of the population, unless they're already on their way
+  if ( params->ASYNC_FITNESS ) {
+    if ( params->PIPELINE ) {
+      // Slots nobody was bred into this time get evaluated again, as they would in one batch
+      for ( ; baby && !this->screen; baby = baby->next )
+	getFitness((void *)baby);
+    } else {
+      lock();
+      if ( this->screen ) {
+	for ( unsigned int i=0; i<this->screen->pending.size(); i++ )
+	  getFitness((void *)this->screen->pending[i].who);
+      } else {
+	baby = newPopulation->first;
+	while ( baby ) {
+	  getFitness((void *)baby);
+	  baby = baby->next;
+	}
+      }
+      unlock();
     }
-    unlock();
+    t = phase_mark(PHASE_DISPATCH, t);
+    span = trace_mark("dispatch", span);
     wait_for_threads();
+    t = phase_mark(PHASE_WAIT, t);
+    span = trace_mark("wait", span);
   }
+  if ( this->screen )
+    this->screen->learn();
+  perf_mark(PERF_EVALUATION);
 
   if ( newCount < newPopulation->last->count ) {
     newPopulation->trim( newCount );
@@ -255,18 +446,25 @@ void population::mate( void ) {
   }
 
   if ( params->VERBOSE == 3 ) {
-    printf("/================ new population ======================/\n");
+    log_str("/================ new population ======================/\n");
     newPopulation->dump();
-    printf("/======================================================/\n");
+    log_str("/======================================================/\n");
   }
 
 
   // Keep the elitist bastards around for a while
   if (params->ELITISM_GENERATIONS > 0)
     this->copy_elites();
+  t = phase_mark(PHASE_ELITES, t);
+  span = trace_mark("elites", span);
 
-  // Either way we go, we'll need a sorted population
+  // Either way we go, we'll need a sorted population, with real evaluations at the top
   newPopulation->sort();
+  if ( this->screen )
+    this->screen->confirm(newPopulation);
+  phase_mark(PHASE_SORT, t);
+  perf_mark(PERF_SORT);
+  trace_mark("sort", span);
 
   //newPopulation->get_fittest();
 
@@ -277,24 +475,48 @@ void population::mate( void ) {
   this->mating_in_progress = false;
   newPopulation->mating_in_progress = false;
 
+  if ( timing )
+    timing->end_generation(this->generation);
+  if ( counters )
+    counters->end_generation(this->generation);
+  trace_end("generation", started, this->generation);
+
   if ( params->VERBOSE == 3 ) {
     individual *newP = newPopulation->first;
     individual *oldP = this->first;
-    printf("\nGeneration %i complete\n", this->generation);
+    log_printf("\nGeneration %i complete\n", this->generation);
     while ( newP && oldP ) {
-      printf("newPop %02i = %f\tPop %02i = %f\n", newP->count, newP->fitness, oldP->count, oldP->fitness);
+      log_str("newPop ");
+      log_int(newP->count, 2);
+      log_str(" = ");
+      log_fixed(newP->fitness, 6);
+      log_str("\tPop ");
+      log_int(oldP->count, 2);
+      log_str(" = ");
+      log_fixed(oldP->fitness, 6);
+      log_char('\n');
       newP = newP->next;
       oldP = oldP->next;
     }
-    printf("/======================================================/\n\n");
+    log_str("/======================================================/\n\n");
   }
 
   return;
 }
 
+/*-- The population mate() breeds into. Every slot in it gets overwritten, so it
+     starts out empty rather than wasting evaluations (or random numbers) --*/
+population *population::scratch( bool create ) {
+  if ( !newPopulation && create )
+    newPopulation = new population( false );
+  return newPopulation;
+}
+
 void population::copy( population *newPop ) {
 
   individual *oldP, *newP;
+  uint64_t t = phase_start();
+  uint64_t span = trace_begin();
 
   oldP = this->first;
   newP = newPop->first;
@@ -322,6 +544,8 @@ void population::copy( population *newPop ) {
   this->average = 0.0;
   this->stdev = 0.0;
   this->variation = 0.0;
+  t = phase_mark(PHASE_COPY, t);
+  span = trace_mark("copy", span);
 
   /*-- Keep a pointer to the most fit individual for efficiency --*/
   this->get_fittest();
@@ -329,9 +553,9 @@ void population::copy( population *newPop ) {
   this->count = this->last->count;
   this->check_for_clones();
   this->get_statistics();
-
-  if ( this->generation && !(this->generation % 50 ) )
-    this->mutation_gain();
+  phase_mark(PHASE_STATISTICS, t);
+  perf_mark(PERF_STATISTICS);
+  trace_mark("statistics", span);
 
   return;
 }
@@ -374,23 +598,47 @@ void population::check_for_clones() {
   return;
 }
 
+/*-- The status line, at most LOG_STATUS_HZ times a second; the terminal can't show more --*/
 void population::print(void) {
 
-  if ( params->VERBOSE > 0 && params->VERBOSE <= 2 ) {
-    printf("Most fit %0.*f ", 
-	   params->ACCURACY, this->mostfit->fitness);
+  if ( params->VERBOSE > 0 && params->VERBOSE <= 2 && log_status_due(this->generation) ) {
+    log_str("Most fit ");
+    log_fixed(this->mostfit->fitness, params->ACCURACY);
 
-    printf("Generation %i ", this->generation);
+    log_str(" Generation ");
+    log_int(this->generation);
+    log_char(' ');
 
     if ( params->VERBOSE == 1 )
-      printf("     \r");
+      log_str("     \r");
     else if ( params->VERBOSE == 2 ) {
-      printf(" Pop. %i (%i clones) Stats: Avg = %0.1f StDev = %0.1f Var = %0.1f persist = %i rate = %0.2f ",
-	     this->count, this->clones, this->average, this->stdev, this->variation, this->mostfit->generation,
-	     params->MUTATION_RATE);
+      log_str(" Pop. ");
+      log_int(this->count);
+      log_str(" (");
+      log_int(this->clones);
+      log_str(" clones");
+      if ( this->bounded ) {
+	log_str(", ");
+	log_int(this->bounded);
+	log_str(" bounded");
+      }
+      if ( this->estimated ) {
+	log_str(", ");
+	log_int(this->estimated);
+	log_str(" predicted");
+      }
+      log_str(") Stats: Avg = ");
+      log_fixed(this->average, 1);
+      log_str(" StDev = ");
+      log_fixed(this->stdev, 1);
+      log_str(" Var = ");
+      log_fixed(this->variation, 1);
+      log_str(" persist = ");
+      log_int(this->mostfit->generation);
+      log_str(" rate = ");
+      log_fixed(this->mutation_rate, 2);
+      log_char(' ');
     }
-
-    fflush(stdout);
   }
   return;
 }
@@ -403,10 +651,20 @@ void population::dump( int max ) {
     max = this->last->count;
 
   while ( temp && counter++ < max ) {
-    printf("%03i (", temp->count);
-    for ( int i=0; i<params->NUMBER_OF_GENES; i++ )
-	    printf(" %+.*f,", params->ACCURACY, temp->gene[i]);
-	  printf("\b )\t=> fitness = %.*f\n", params->ACCURACY, temp->fitness);
+    log_int(temp->count, 3);
+    log_str(" (");
+    for ( int i=0; i<params->NUMBER_OF_GENES; i++ ) {
+      log_char(' ');
+      log_fixed((double)gene_value(temp->gene[i]), params->ACCURACY, true);
+      log_char(',');
+    }
+    log_str("\b )\t=> fitness = ");
+    log_fixed(temp->fitness, params->ACCURACY);
+    if ( temp->estimated )
+      log_str(" (predicted)");
+    else if ( temp->bounded )
+      log_str(" (bounded)");
+    log_char('\n');
     temp = temp->next;
   }
   return;
@@ -417,7 +675,7 @@ void population::flush( void ) {
 
   this->person = this->first;
   while ( this->person != NULL ) {
-    *this->person->gene = {0.0f};
+    *this->person->gene = 0;
     this->person->fitness = params->MAX_FITNESS;
 
     this->person = this->person->next;
@@ -572,20 +830,44 @@ void population::get_statistics( void ) {
   // Unbiased estimator of the coefficient of variation for normal populations
   this->variation = (1 + 1/(4*this->count))*var;
 
+  // Each individual carries its own rate now; this is only for reporting
+  double rates = 0.0;
+  for ( person = this->first; person; person = person->next )
+    rates += person->mutation_rate;
+  this->mutation_rate = rates/this->last->count;
+
   return;
 }
 
+/*
+ * Over the individuals with exact fitness; bounded ones are only known to
+ * be out of the running, and predicted ones were never evaluated at all
+ */
 float population::get_avg_fitness( void ) {
 
   this->average = 0.0f;
+  this->bounded = 0;
+  this->estimated = 0;
+  float worst = -INFINITY;
 
   person = this->first;
   while ( person != NULL ) {
-    this->average += person->fitness;
+    if ( person->bounded )
+      this->bounded++;
+    else if ( person->estimated )
+      this->estimated++;
+    else {
+      this->average += person->fitness;
+      if ( person->fitness > worst )
+	worst = person->fitness;
+    }
     person = person->next;
   }
+  this->worst = (worst > -INFINITY) ? worst : INFINITY;
 
-  this->average /= this->last->count;
+  unsigned int inexact = this->bounded + this->estimated;
+  if ( inexact < (unsigned int)this->last->count )
+    this->average /= this->last->count - inexact;
 
   return this->average;
 }
@@ -595,12 +877,16 @@ float population::get_stdev_fitness( void ) {
   this->stdev = 0.0f;
   person = this->first;
   while ( person != NULL ) {
-    this->stdev += (person->fitness - this->average)*(person->fitness - this->average);
+    if ( !person->bounded && !person->estimated )
+      this->stdev += (person->fitness - this->average)*(person->fitness - this->average);
     person = person->next;
   }
 
-  if ( this->stdev >= 0.0f )
-    this->stdev = sqrt(this->stdev/this->last->count);
+  unsigned int inexact = this->bounded + this->estimated;
+  if ( inexact >= (unsigned int)this->last->count )
+    this->stdev = 0.0f;
+  else if ( this->stdev >= 0.0f )
+    this->stdev = sqrt(this->stdev/(this->last->count - inexact));
   else
     this->stdev = -1.0f;
 
@@ -643,44 +929,6 @@ void population::recount( void ) {
   return;
 }
 
-/*-- Modify the rate of mutation based on population distribution --*/
-void population::mutation_gain( void ) {
-
-  if ( params->MUTATION_RATE >= 0.5 ) {
-    params->MUTATION_RATE = 0.5f;
-    return;
-  }
-
-  if ( this->mostfit->generation > 500 ) {
-    if ( params->VERBOSE > 1 )
-      cout << "\nincreasing rate for persistance of " << this->mostfit->generation << "\n";
-    params->MUTATION_RATE += params->MUTATION_GAIN;
-  }
-
-  if ( this->variation < 0.5f ) {
-    if ( params->VERBOSE > 1 )
-      cout << "\nincreasing rate for variation of " << this->variation << "\n";
-    params->MUTATION_RATE += params->MUTATION_GAIN;
-  }
-
-  if  ( this->clones > 0.025*this->last->count ) {
-    if ( params->VERBOSE > 1 )
-      cout << "\nincreasing rate for cloning rate of " << (float)this->clones/(float)this->last->count << "\n";
-    params->MUTATION_RATE += params->MUTATION_GAIN;
-  }
-
-  if ( this->variation > 5.0f ) {
-    if ( params->VERBOSE > 1 )
-      cout << "\ndecreasing rate for variation of " << this->variation << "\n";
-    params->MUTATION_RATE -= params->MUTATION_GAIN;
-  }
-
-  if ( params->MUTATION_RATE > 0.5 )
-    params->MUTATION_RATE = 0.5f;
-
-  return;
-}
-
 // Sort ascending by fitness
 void population::sort() {
 
@@ -711,8 +959,10 @@ void population::sort() {
     popArray[i]->count = i;
     if ( i==1 ) {
       popArray[1]->previous = NULL;
-      popArray[1]->next = popArray[2];
+      popArray[1]->next = ( n > 1 ) ? popArray[2] : NULL;
       this->first = this->mostfit = popArray[1];
+      if ( n == 1 )
+	this->last = popArray[1];
 
     } else if ( i == n ) {
       popArray[n]->next = NULL;
@@ -6,6 +6,12 @@
 #include "parameters.h"
 #include "utilities.h"
 #include "fitness.h"
+#include "popfile.h"
+#include "phases.h"
+#include "perf.h"
+#include "trace.h"
+#include "log.h"
+#include "surrogate.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -16,8 +22,19 @@
 
 class population {
 
+  friend class checkpoint;
+  friend class popfile;
+  friend class bench;
+  friend class plotter;
+  friend class steady_state;
+  friend class cmaes;
+  friend class differential_evolution;
+  friend class nsga2;
+  friend class surrogate;
+
  public:
-  population( void );
+  population( bool = true );
+  population( popfile * );
   ~population( void );
 
   float get_avg_fitness( void );
@@ -30,25 +47,32 @@ class population {
   void print( void );
 
   unsigned int clones;
+  unsigned int bounded;             // cut off early, fitness only a lower bound; not in the statistics
+  unsigned int estimated;           // fitness predicted by the surrogate; not in the statistics either
+  float worst;                      // worst exact fitness, as of the last get_avg_fitness()
   unsigned int count;
   double stdev;
   double average;
   double variation;
+  double mutation_rate;             // average, individuals carry their own
 
   individual *mostfit;
+  surrogate *screen;                // SURROGATE's pre-screening of mate()'s children, or NULL
 
  protected:
 
  private:
+  void setup( void );
+  void quasi_genes( individual *, int );
   void copy_elites( void );
   void roulette_fill( void );
   void check_for_clones( void );
   void recount( void );
   void copy( population * );
+  population *scratch( bool = false );
   void flush( void );
   void trim ( int );
   void get_fittest( void );
-  void mutation_gain( void );
   void get_statistics( void );
 
   void sort( void );
@@ -0,0 +1,552 @@
+#include "remote.h"
+
+#include <poll.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+/*-- Monotonic wall clock in seconds, for heartbeats and timeouts --*/
+double remote_clock( void ) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1.0e-9*ts.tv_nsec;
+}
+
+/*-- Split host:port, returning false if there is no port --*/
+static bool split_address( const char *address, string &host, string &port ) {
+  const char *colon = strrchr(address, ':');
+  if ( !colon )
+    return false;
+  host.assign(address, colon - address);
+  port.assign(colon + 1);
+  return true;
+}
+
+/*-- Start a connect; without waiting for it, it's finished once the socket polls writable --*/
+static int start_connect( int fd, const struct sockaddr *sa, socklen_t len, bool waiting ) {
+  if ( !waiting )
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  if ( !connect(fd, sa, len) || (!waiting && errno == EINPROGRESS) )
+    return 0;
+  return -1;
+}
+
+static int open_socket( const char *address, bool listening, bool waiting = true ) {
+  int fd = -1;
+
+  if ( !strncmp(address, "unix:", 5) ) {
+    struct sockaddr_un sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    strncpy(sa.sun_path, address+5, sizeof(sa.sun_path)-1);
+
+    if ( (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 )
+      return -1;
+
+    if ( listening ) {
+      unlink(sa.sun_path);
+      if ( bind(fd, (struct sockaddr *)&sa, sizeof(sa)) || listen(fd, 8) ) {
+	close(fd);
+	return -1;
+      }
+    } else if ( start_connect(fd, (struct sockaddr *)&sa, sizeof(sa), waiting) ) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  }
+
+  string host, port;
+  if ( !split_address(address, host, port) ) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  struct addrinfo hints, *res, *ai;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags    = listening ? AI_PASSIVE : 0;
+
+  if ( getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &res) ) {
+    errno = EHOSTUNREACH;
+    return -1;
+  }
+
+  for ( ai = res; ai; ai = ai->ai_next ) {
+    if ( (fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0 )
+      continue;
+
+    int one = 1;
+    if ( listening ) {
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+      if ( !bind(fd, ai->ai_addr, ai->ai_addrlen) && !listen(fd, 8) )
+	break;
+    } else if ( !start_connect(fd, ai->ai_addr, ai->ai_addrlen, waiting) ) {
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+
+  return fd;
+}
+
+int remote_connect( const char *address, bool waiting ) {
+  return open_socket(address, false, waiting);
+}
+
+int remote_listen( const char *address ) {
+  return open_socket(address, true);
+}
+
+/*-- Write or read exactly n bytes, riding out signals and short transfers --*/
+static bool write_all( int fd, const void *buffer, size_t n ) {
+  const char *p = (const char *)buffer;
+  while ( n ) {
+    ssize_t bytes = send(fd, p, n, MSG_NOSIGNAL);
+    if ( bytes < 0 && errno == EINTR )
+      continue;
+    if ( bytes <= 0 )
+      return false;
+    p += bytes;
+    n -= bytes;
+  }
+  return true;
+}
+
+static bool read_all( int fd, void *buffer, size_t n ) {
+  char *p = (char *)buffer;
+  while ( n ) {
+    ssize_t bytes = recv(fd, p, n, 0);
+    if ( bytes < 0 && errno == EINTR )
+      continue;
+    if ( bytes <= 0 )
+      return false;
+    p += bytes;
+    n -= bytes;
+  }
+  return true;
+}
+
+bool remote_send( int fd, uint16_t type, uint32_t batch, uint32_t count,
+		  const void *payload, size_t bytes ) {
+  frame_header hdr;
+  hdr.magic   = REMOTE_MAGIC;
+  hdr.version = REMOTE_VERSION;
+  hdr.type    = type;
+  hdr.batch   = batch;
+  hdr.count   = count;
+
+  /*-- Small frames go out as a single segment --*/
+  if ( bytes <= 4096 ) {
+    char frame[sizeof(hdr) + 4096];
+    memcpy(frame, &hdr, sizeof(hdr));
+    if ( bytes )
+      memcpy(frame + sizeof(hdr), payload, bytes);
+    return write_all(fd, frame, sizeof(hdr) + bytes);
+  }
+
+  return write_all(fd, &hdr, sizeof(hdr)) && write_all(fd, payload, bytes);
+}
+
+/*-- Read one frame. The payload size is implied by the type, count and gene count --*/
+bool remote_recv( int fd, frame_header *hdr, vector<char> &payload ) {
+
+  if ( !read_all(fd, hdr, sizeof(*hdr)) )
+    return false;
+
+  if ( hdr->magic != REMOTE_MAGIC || hdr->version != REMOTE_VERSION ) {
+    fprintf(stderr, "\nremote: bad frame (magic %08x version %i)\n", hdr->magic, hdr->version);
+    return false;
+  }
+
+  uint64_t bytes = 0;
+  if ( hdr->type == FRAME_BATCH )
+    bytes = (uint64_t)hdr->count*params->NUMBER_OF_GENES*sizeof(gene_t);
+  else if ( hdr->type == FRAME_RESULT )
+    bytes = (uint64_t)hdr->count*sizeof(float);
+
+  // The count is whatever the other end says it is, so it's checked before it costs anything
+  if ( bytes > REMOTE_MAX_PAYLOAD ) {
+    fprintf(stderr, "\nremote: frame of %u individuals is over the %u byte limit\n", hdr->count, REMOTE_MAX_PAYLOAD);
+    return false;
+  }
+
+  payload.resize(bytes);
+  return !bytes || read_all(fd, &payload[0], bytes);
+}
+
+/*-- Connect to every worker in a comma separated address list --*/
+remotepool::remotepool( const char *addresses, unsigned int size, unsigned int pipeline,
+			double beat, double dead ) {
+
+  this->nGenes     = params->NUMBER_OF_GENES;
+  this->batch_size = size ? size : 1;
+  this->depth      = pipeline ? pipeline : 1;
+  this->heartbeat  = beat;
+  this->timeout    = dead;
+  this->next_batch = 1;
+
+  if ( (uint64_t)this->batch_size*this->nGenes*sizeof(gene_t) > REMOTE_MAX_PAYLOAD ) {
+    fprintf(stderr, "REMOTE_BATCH_SIZE %u is too large, a batch of %i genes each has to fit in %u bytes\n",
+	    this->batch_size, this->nGenes, REMOTE_MAX_PAYLOAD);
+    exit(EINVAL);
+  }
+
+  string list(addresses);
+  size_t start = 0;
+  while ( start < list.size() ) {
+    size_t comma = list.find(',', start);
+    if ( comma == string::npos )
+      comma = list.size();
+
+    worker w;
+    w.address  = list.substr(start, comma - start);
+    w.fd       = -1;
+    w.state    = LINK_DOWN;
+    w.retry_at = 0.0;
+    if ( !w.address.empty() ) {
+      this->connect_worker(w);
+      this->workers.push_back(w);
+    }
+    start = comma + 1;
+  }
+
+  /*-- The connections all go at once, so a dead worker costs one timeout, not one each --*/
+  bool pending = true;
+  while ( pending ) {
+    this->pump(100);
+    pending = false;
+    for ( unsigned int i=0; i<this->workers.size(); i++ )
+      pending = pending || this->workers[i].state == LINK_CONNECTING || this->workers[i].state == LINK_HELLO;
+  }
+
+  unsigned int alive = 0;
+  for ( unsigned int i=0; i<this->workers.size(); i++ ) {
+    if ( this->workers[i].state == LINK_UP )
+      alive++;
+    else
+      fprintf(stderr, "remote: unable to reach worker %s\n", this->workers[i].address.c_str());
+  }
+
+  if ( !alive ) {
+    fprintf(stderr, "remote: no fitness workers available in %s\n", addresses);
+    exit(EHOSTDOWN);
+  }
+
+  if ( params->VERBOSE > 1 )
+    fprintf(stderr, "remote: %i of %i fitness workers connected\n", alive, (int)this->workers.size());
+
+  return;
+}
+
+remotepool::~remotepool( void ) {
+  for ( unsigned int i=0; i<this->workers.size(); i++ ) {
+    if ( this->workers[i].state == LINK_UP )
+      remote_send(this->workers[i].fd, FRAME_BYE, 0, 0);
+    if ( this->workers[i].fd >= 0 )
+      close(this->workers[i].fd);
+  }
+  return;
+}
+
+/*
+ * Start connecting, without waiting: pump() polls the socket along with
+ * the others, and handshake() exchanges HELLOs once it's connected, so
+ * both ends agree on the genome size and type. A worker that doesn't get
+ * that far within the timeout is tried again a timeout later.
+ */
+void remotepool::connect_worker( worker &w ) {
+
+  w.last_seen = remote_clock();
+  w.fd = remote_connect(w.address.c_str(), false);
+  if ( w.fd < 0 ) {
+    w.state = LINK_DOWN;
+    w.retry_at = w.last_seen + this->timeout;
+    return;
+  }
+
+  w.state = LINK_CONNECTING;
+  return;
+}
+
+/*-- Move a connecting worker along once its socket is ready --*/
+void remotepool::handshake( unsigned int which ) {
+  worker &w = this->workers[which];
+
+  if ( w.state == LINK_CONNECTING ) {
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if ( getsockopt(w.fd, SOL_SOCKET, SO_ERROR, &error, &len) || error ) {
+      this->disconnect(which);
+      return;
+    }
+
+    // From here on the socket is used like any other, a whole frame at a time
+    fcntl(w.fd, F_SETFL, fcntl(w.fd, F_GETFL) & ~O_NONBLOCK);
+    if ( !remote_send(w.fd, FRAME_HELLO, GENE_FORMAT, this->nGenes) ) {
+      this->disconnect(which);
+      return;
+    }
+    w.state = LINK_HELLO;
+    return;
+  }
+
+  frame_header hdr;
+  vector<char> none;
+  if ( !remote_recv(w.fd, &hdr, none) ||
+       hdr.type != FRAME_HELLO || (int)hdr.count != this->nGenes || hdr.batch != GENE_FORMAT ) {
+    fprintf(stderr, "remote: worker %s refused a %i gene genome of format %#x\n",
+	    w.address.c_str(), this->nGenes, GENE_FORMAT);
+    this->disconnect(which);
+    return;
+  }
+
+  w.state = LINK_UP;
+  w.last_seen = w.last_ping = remote_clock();
+  return;
+}
+
+/*-- Close a worker's connection and try it again a timeout from now --*/
+void remotepool::disconnect( unsigned int which ) {
+  worker &w = this->workers[which];
+
+  close(w.fd);
+  w.fd = -1;
+  w.state = LINK_DOWN;
+  w.retry_at = remote_clock() + this->timeout;
+
+  return;
+}
+
+/*-- Give up on a worker and put its work back at the head of the line --*/
+void remotepool::drop_worker( unsigned int which ) {
+  worker &w = this->workers[which];
+
+  fprintf(stderr, "\nremote: lost worker %s, resubmitting %i batches\n",
+	  w.address.c_str(), (int)w.in_flight.size());
+
+  while ( !w.in_flight.empty() ) {
+    this->outstanding[w.in_flight.back()].owner = -1;
+    this->unsent.push_front(w.in_flight.back());
+    w.in_flight.pop_back();
+  }
+
+  this->disconnect(which);
+  return;
+}
+
+/*-- Turn the partially filled batch into one that can be sent --*/
+void remotepool::seal( void ) {
+  if ( this->filling.empty() )
+    return;
+
+  batch &b = this->outstanding[this->next_batch];
+  b.person.swap(this->filling);
+  b.owner = -1;
+  this->unsent.push_back(this->next_batch++);
+
+  this->filling.clear();
+  this->filling.reserve(this->batch_size);
+  return;
+}
+
+/*-- Hand unsent batches to the least loaded workers, up to the pipeline depth --*/
+void remotepool::dispatch( void ) {
+
+  double now = remote_clock();
+
+  while ( !this->unsent.empty() ) {
+
+    int best = -1;
+    for ( unsigned int i=0; i<this->workers.size(); i++ ) {
+      worker &w = this->workers[i];
+
+      if ( w.state == LINK_DOWN && now >= w.retry_at )
+	this->connect_worker(w);
+      if ( w.state != LINK_UP || w.in_flight.size() >= this->depth )
+	continue;
+      if ( best < 0 || w.in_flight.size() < this->workers[best].in_flight.size() )
+	best = i;
+    }
+
+    if ( best < 0 )
+      return;
+
+    uint32_t id = this->unsent.front();
+    batch &b = this->outstanding[id];
+
+    this->genes.resize(b.person.size()*this->nGenes);
+    for ( unsigned int i=0; i<b.person.size(); i++ )
+      memcpy(&this->genes[i*this->nGenes], b.person[i]->gene, this->nGenes*sizeof(gene_t));
+
+    if ( !remote_send(this->workers[best].fd, FRAME_BATCH, id, b.person.size(),
+		      &this->genes[0], this->genes.size()*sizeof(gene_t)) ) {
+      this->drop_worker(best);
+      continue;
+    }
+
+    b.owner = best;
+    this->workers[best].in_flight.push_back(id);
+    this->unsent.pop_front();
+  }
+
+  return;
+}
+
+/*-- Handle one incoming frame from a worker --*/
+void remotepool::receive( unsigned int which ) {
+  worker &w = this->workers[which];
+  frame_header hdr;
+
+  if ( !remote_recv(w.fd, &hdr, this->payload) || hdr.type == FRAME_BYE ) {
+    this->drop_worker(which);
+    return;
+  }
+
+  w.last_seen = remote_clock();
+
+  if ( hdr.type != FRAME_RESULT )
+    return;
+
+  map<uint32_t, batch>::iterator it = this->outstanding.find(hdr.batch);
+  if ( it == this->outstanding.end() || it->second.owner != (int)which ||
+       hdr.count != it->second.person.size() ) {
+    fprintf(stderr, "\nremote: stray result for batch %u from %s\n", hdr.batch, w.address.c_str());
+    return;
+  }
+
+  const float *fitness = (const float *)this->payload.data();
+  for ( unsigned int i=0; i<hdr.count; i++ )
+    it->second.person[i]->fitness = fitness[i];
+
+  for ( deque<uint32_t>::iterator f = w.in_flight.begin(); f != w.in_flight.end(); f++ ) {
+    if ( *f == hdr.batch ) {
+      w.in_flight.erase(f);
+      break;
+    }
+  }
+  this->outstanding.erase(it);
+
+  return;
+}
+
+/*-- Send what we can, read what has arrived and check on the workers' health --*/
+void remotepool::pump( int wait_ms ) {
+
+  this->dispatch();
+
+  vector<struct pollfd> pfd;
+  vector<unsigned int> owner;
+  for ( unsigned int i=0; i<this->workers.size(); i++ ) {
+    if ( this->workers[i].fd >= 0 ) {
+      short events = ( this->workers[i].state == LINK_CONNECTING ) ? POLLOUT : POLLIN;
+      struct pollfd p = { this->workers[i].fd, events, 0 };
+      pfd.push_back(p);
+      owner.push_back(i);
+    }
+  }
+
+  if ( pfd.empty() ) {
+    if ( wait_ms )
+      usleep(1000*wait_ms);
+    return;
+  }
+
+  int ready = poll(&pfd[0], pfd.size(), wait_ms);
+  if ( ready < 0 && errno != EINTR ) {
+    perror("remote: poll");
+    exit(errno);
+  }
+
+  for ( unsigned int i=0; ready > 0 && i<pfd.size(); i++ ) {
+    if ( !(pfd[i].revents & (POLLIN | POLLOUT | POLLHUP | POLLERR)) )
+      continue;
+    if ( this->workers[owner[i]].state == LINK_UP )
+      this->receive(owner[i]);
+    else
+      this->handshake(owner[i]);
+  }
+
+  /*-- Heartbeats only matter for workers holding our work --*/
+  double now = remote_clock();
+  for ( unsigned int i=0; i<this->workers.size(); i++ ) {
+    worker &w = this->workers[i];
+    if ( w.fd >= 0 && w.state != LINK_UP && now - w.last_seen > this->timeout )
+      this->disconnect(i);
+    if ( w.state != LINK_UP || w.in_flight.empty() )
+      continue;
+
+    if ( now - w.last_seen > this->timeout )
+      this->drop_worker(i);
+    else if ( now - w.last_seen > this->heartbeat && now - w.last_ping > this->heartbeat ) {
+      w.last_ping = now;
+      if ( !remote_send(w.fd, FRAME_PING, 0, 0) )
+	this->drop_worker(i);
+    }
+  }
+
+  return;
+}
+
+/*-- Add an individual to the current batch, shipping it once the batch is full --*/
+void remotepool::enqueue( void *p ) {
+
+  this->filling.push_back((individual *)p);
+
+  if ( this->filling.size() >= this->batch_size ) {
+    this->seal();
+    this->pump(0);
+  }
+
+  return;
+}
+
+/*-- Block until every individual handed to enqueue() has a fitness --*/
+void remotepool::wait_until_empty( void ) {
+
+  this->seal();
+
+  double stranded = 0.0;
+  while ( !this->outstanding.empty() ) {
+    this->pump((int)(250*this->heartbeat) + 1);
+
+    unsigned int alive = 0;
+    for ( unsigned int i=0; i<this->workers.size(); i++ )
+      alive += (this->workers[i].state == LINK_UP);
+
+    /*-- Keep trying to reconnect for a while before calling it quits --*/
+    if ( alive ) {
+      stranded = 0.0;
+    } else if ( stranded == 0.0 ) {
+      stranded = remote_clock();
+    } else if ( remote_clock() - stranded > 10*this->timeout ) {
+      fprintf(stderr, "\nremote: every fitness worker is gone, %i batches unfinished\n",
+	      (int)this->outstanding.size());
+      exit(EHOSTDOWN);
+    }
+  }
+
+  return;
+}
+
+unsigned int remotepool::get_pool_size( void ) {
+  unsigned int alive = 0;
+  for ( unsigned int i=0; i<this->workers.size(); i++ )
+    alive += (this->workers[i].state == LINK_UP);
+  return alive;
+}
+
+unsigned int remotepool::get_queue_size( void ) {
+  unsigned int queued = this->filling.size();
+  for ( map<uint32_t, batch>::iterator it = this->outstanding.begin(); it != this->outstanding.end(); it++ )
+    queued += it->second.person.size();
+  return queued;
+}
@@ -0,0 +1,139 @@
+#ifndef __REMOTE_H
+#define __REMOTE_H
+
+#include "global.h"
+#include "individual.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+
+using namespace std;
+
+/*
+ * Wire protocol between the coordinator (remotepool, inside the ga process)
+ * and the evaluation workers (ga_worker). Every message is a fixed 16 byte
+ * header followed by an optional payload:
+ *
+ *   HELLO   count = number of genes, batch = GENE_FORMAT, no payload. Sent by
+ *           both ends on connect
+ *   BATCH   count individuals, payload = count*nGenes genes
+ *   RESULT  count fitness values for the batch with the same sequence number
+ *   PING    heartbeat request, answered by a PONG
+ *   BYE     orderly shutdown, or a refused HELLO
+ *
+ * Everything is sent in host byte order, the evaluation nodes are expected
+ * to be the same architecture as the coordinator. A frame whose payload
+ * would be over REMOTE_MAX_PAYLOAD is refused before anything is
+ * allocated for it, so REMOTE_BATCH_SIZE has to fit in that.
+ */
+#define REMOTE_MAGIC    0x47414657     // "GAFW"
+#define REMOTE_VERSION  1
+#define REMOTE_MAX_PAYLOAD  (64u << 20)
+
+enum frame_type {
+  FRAME_HELLO = 1,
+  FRAME_BATCH,
+  FRAME_RESULT,
+  FRAME_PING,
+  FRAME_PONG,
+  FRAME_BYE
+};
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t type;
+  uint32_t batch;       // Sequence number, echoed back in the RESULT
+  uint32_t count;       // Individuals in the batch (HELLO: number of genes)
+} frame_header;
+
+/*
+ * Socket helpers shared by both ends. Addresses are unix:/path or host:port.
+ * remote_connect( address, false ) returns as soon as the connect is under
+ * way, non-blocking; it has finished once the socket polls writable.
+ */
+int  remote_connect( const char *, bool = true );
+int  remote_listen( const char * );
+bool remote_send( int, uint16_t, uint32_t, uint32_t, const void * = NULL, size_t = 0 );
+bool remote_recv( int, frame_header *, vector<char> & );
+double remote_clock( void );
+
+/*
+ * Stand in for the threadpool when fitness evaluation is farmed out to
+ * ga_worker processes. Individuals are collected into batches, batches are
+ * pipelined to the workers and the fitness values are written back when
+ * the results arrive. Work held by a worker that stops answering heartbeats
+ * is handed to the next available worker.
+ */
+class remotepool {
+
+ public:
+  remotepool( const char *, unsigned int = 64, unsigned int = 4, double = 1.0, double = 30.0 );
+  ~remotepool( void );
+
+  void enqueue( void * );
+  void wait_until_empty( void );
+
+  unsigned int get_pool_size( void );
+  unsigned int get_queue_size( void );
+
+ protected:
+
+ private:
+
+  enum link_state {
+    LINK_DOWN,          // no connection, tried again at retry_at
+    LINK_CONNECTING,    // connect() under way
+    LINK_HELLO,         // connected, waiting for the worker's HELLO
+    LINK_UP
+  };
+
+  typedef struct {
+    string address;
+    int fd;
+    link_state state;
+    deque<uint32_t> in_flight;
+    double last_seen;
+    double last_ping;
+    double retry_at;
+  } worker;
+
+  typedef struct {
+    vector<individual *> person;
+    int owner;
+  } batch;
+
+  void connect_worker( worker & );
+  void handshake( unsigned int );
+  void disconnect( unsigned int );
+  void drop_worker( unsigned int );
+  void seal( void );
+  void dispatch( void );
+  void pump( int );
+  void receive( unsigned int );
+
+  vector<worker> workers;
+  map<uint32_t, batch> outstanding;
+  deque<uint32_t> unsent;
+  vector<individual *> filling;
+  vector<char> payload;
+  vector<gene_t> genes;
+
+  uint32_t next_batch;
+  unsigned int batch_size;
+  unsigned int depth;
+  double heartbeat;
+  double timeout;
+  int nGenes;
+};
+
+#endif
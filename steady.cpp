@@ -0,0 +1,331 @@
+#include "steady.h"
+#include "genome.h"
+#include "trace.h"
+
+#include <string.h>
+#include <errno.h>
+
+steady_state::steady_state( population *society, int nthreads ) {
+
+  this->society = society;
+  this->size = society->last->count;
+  this->tournament_size = params->getInt(params->handle("TOURNAMENT_SIZE", PARAM_INT));
+  if ( this->tournament_size < 2 )
+    this->tournament_size = 2;
+
+  this->slots = new steady_slot [this->size];
+  individual *person = society->first;
+  for ( int i=0; i<this->size && person; i++ ) {
+    this->slots[i].version.store(0);
+    this->slots[i].fitness.store(person->fitness);
+    this->slots[i].mutation_rate.store(person->mutation_rate);
+    this->slots[i].who = person;
+    person = person->next;
+  }
+
+  this->champion = new individual();
+  this->base_generation = society->generation;
+
+  // With a generation limit the workers stop at that many evaluations, not wherever main is
+  if ( params->MAXIMUM_GENERATIONS > (int)society->generation )
+    this->limit = (unsigned long)(params->MAXIMUM_GENERATIONS - society->generation)*this->size;
+  else
+    this->limit = 0;
+
+  this->evaluations = 0;
+  this->replacements = 0;
+  this->stopping = false;
+  this->pausing = false;
+  this->parked = 0;
+  this->started = 0;
+
+  pthread_mutex_init(&this->lock, NULL);
+  pthread_cond_init(&this->epoch, NULL);
+  pthread_cond_init(&this->parking, NULL);
+  pthread_cond_init(&this->waking, NULL);
+
+  this->statistics();
+
+  // Each worker's generator is seeded from the main one, so SEED still means something
+  int workers = ( nthreads > 0 ) ? nthreads : 1;
+  for ( int i=0; i<workers; i++ )
+    this->seeds.push_back((unsigned int)random());
+
+  this->threads.resize(workers);
+  for ( int i=0; i<workers; i++ ) {
+    if ( pthread_create(&this->threads[i], NULL, steady_state::worker, this) ) {
+      perror("steady_state: pthread_create");
+      exit(errno);
+    }
+  }
+
+  return;
+}
+
+steady_state::~steady_state( void ) {
+
+  this->stop();
+
+  delete this->champion;
+  delete [] this->slots;
+
+  pthread_cond_destroy(&this->waking);
+  pthread_cond_destroy(&this->parking);
+  pthread_cond_destroy(&this->epoch);
+  pthread_mutex_destroy(&this->lock);
+  return;
+}
+
+/*-- Wait for another population's worth of evaluations, then keep score --*/
+void steady_state::advance( void ) {
+
+  unsigned long target = (unsigned long)(this->society->generation + 1 - this->base_generation)*this->size;
+
+  pthread_mutex_lock(&this->lock);
+  while ( this->evaluations.load() < target && !this->stopping )
+    pthread_cond_wait(&this->epoch, &this->lock);
+  pthread_mutex_unlock(&this->lock);
+
+  this->society->generation++;
+  this->statistics();
+  return;
+}
+
+/*-- Park every worker after the child it's on; the population holds still until resume() --*/
+void steady_state::pause( void ) {
+  pthread_mutex_lock(&this->lock);
+  this->pausing = true;
+  while ( this->parked < (int)this->threads.size() )
+    pthread_cond_wait(&this->parking, &this->lock);
+  pthread_mutex_unlock(&this->lock);
+  return;
+}
+
+void steady_state::resume( void ) {
+  pthread_mutex_lock(&this->lock);
+  this->pausing = false;
+  pthread_cond_broadcast(&this->waking);
+  pthread_mutex_unlock(&this->lock);
+  return;
+}
+
+/*-- Stop the workers for good and leave the population sorted, as mate() would --*/
+void steady_state::stop( void ) {
+
+  if ( this->threads.empty() )
+    return;
+
+  pthread_mutex_lock(&this->lock);
+  this->stopping = true;
+  this->pausing = false;
+  pthread_cond_broadcast(&this->waking);
+  pthread_cond_broadcast(&this->epoch);
+  pthread_mutex_unlock(&this->lock);
+
+  for ( unsigned int i=0; i<this->threads.size(); i++ )
+    pthread_join(this->threads[i], NULL);
+  this->threads.clear();
+
+  this->society->sort();
+  this->society->check_for_clones();
+  this->society->get_statistics();
+
+  if ( params->VERBOSE > 1 )
+    fprintf(stderr, "\nsteady state: %lu children, %lu took a place in the population\n",
+	    this->evaluations.load(), this->replacements.load());
+  return;
+}
+
+/*-- Average and deviation from the published fitness values, and a copy of the best --*/
+void steady_state::statistics( void ) {
+
+  int best = 0;
+  float worst = -INFINITY;
+  double sum = 0.0, rates = 0.0;
+  for ( int i=0; i<this->size; i++ ) {
+    float f = this->slots[i].fitness.load(memory_order_relaxed);
+    if ( f < this->slots[best].fitness.load(memory_order_relaxed) )
+      best = i;
+    if ( f > worst )
+      worst = f;
+    sum += f;
+    rates += this->slots[i].mutation_rate.load(memory_order_relaxed);
+  }
+  double average = sum/this->size;
+
+  double squares = 0.0;
+  for ( int i=0; i<this->size; i++ ) {
+    double d = this->slots[i].fitness.load(memory_order_relaxed) - average;
+    squares += d*d;
+  }
+
+  this->society->average = average;
+  this->society->stdev = sqrt(squares/this->size);
+  this->society->variation = average ? this->society->stdev/average : MAX_INT;
+  this->society->mutation_rate = rates/this->size;
+  this->society->count = this->size;
+  this->worst.store(worst, memory_order_relaxed);
+
+  this->read(best, this->champion);
+  this->society->mostfit = this->champion;
+  return;
+}
+
+/*-- Best (or worst) of TOURNAMENT_SIZE slots picked at random --*/
+int steady_state::tournament( bool fittest ) {
+
+  int winner = randl() % this->size;
+  float score = this->slots[winner].fitness.load(memory_order_relaxed);
+
+  for ( int i=1; i<this->tournament_size; i++ ) {
+    int challenger = randl() % this->size;
+    float f = this->slots[challenger].fitness.load(memory_order_relaxed);
+    if ( fittest ? f < score : f > score ) {
+      winner = challenger;
+      score = f;
+    }
+  }
+
+  return winner;
+}
+
+/*-- Copy slot i without locking it, trying again if a worker replaced it meanwhile --*/
+void steady_state::read( int i, individual *person ) {
+
+  steady_slot *slot = &this->slots[i];
+  while ( true ) {
+    unsigned int version = slot->version.load(memory_order_acquire);
+    if ( version & 1 )
+      continue;
+
+    memcpy(person->gene, slot->who->gene, person->nGenes*sizeof(gene_t));
+    person->fitness = slot->fitness.load(memory_order_relaxed);
+    person->mutation_rate = slot->mutation_rate.load(memory_order_relaxed);
+
+    atomic_thread_fence(memory_order_acquire);
+    if ( slot->version.load(memory_order_relaxed) == version )
+      return;
+  }
+}
+
+void steady_state::breed( individual *daddy, individual *mommy, individual *child ) {
+
+  int d = this->tournament(true);
+  int m = this->tournament(true);
+  for ( int tries = 0; m == d && tries < 8; tries++ )
+    m = this->tournament(true);
+
+  this->read(d, daddy);
+  this->read(m, mommy);
+
+  genome::current()->crossover(daddy->gene, mommy->gene, child->gene);
+  child->mutation_rate = genome::adapt(daddy->mutation_rate, mommy->mutation_rate);
+  if ( child->mutation_rate > 0.0f )
+    genome::current()->mutate(child->gene, child->mutation_rate);
+  child->generation = 0;
+
+  return;
+}
+
+/*-- Put the child in place of a tournament's loser, if it's fitter and the slot is free --*/
+bool steady_state::replace( individual *child ) {
+
+  for ( int tries = 0; tries < 4; tries++ ) {
+    steady_slot *slot = &this->slots[this->tournament(false)];
+
+    if ( !(child->fitness < slot->fitness.load(memory_order_relaxed)) )
+      return false;
+
+    unsigned int version = slot->version.load(memory_order_relaxed);
+    if ( (version & 1) || !slot->version.compare_exchange_strong(version, version + 1, memory_order_acquire) )
+      continue;
+    atomic_thread_fence(memory_order_release);
+
+    // Someone may have put something better here since we looked
+    if ( !(child->fitness < slot->fitness.load(memory_order_relaxed)) ) {
+      slot->version.store(version + 2, memory_order_release);
+      return false;
+    }
+
+    memcpy(slot->who->gene, child->gene, child->nGenes*sizeof(gene_t));
+    slot->who->fitness = child->fitness;
+    slot->who->mutation_rate = child->mutation_rate;
+    slot->who->generation = 0;
+    slot->fitness.store(child->fitness, memory_order_relaxed);
+    slot->mutation_rate.store(child->mutation_rate, memory_order_relaxed);
+    slot->version.store(version + 2, memory_order_release);
+
+    this->replacements.fetch_add(1, memory_order_relaxed);
+    return true;
+  }
+
+  return false;
+}
+
+void *steady_state::worker( void *arg ) {
+  steady_state *self = (steady_state *)arg;
+
+  pthread_mutex_lock(&self->lock);
+  int id = self->started++;
+  pthread_mutex_unlock(&self->lock);
+
+  tracer *t = trace.load(memory_order_acquire);
+  if ( t ) {
+    char name[32];
+    snprintf(name, sizeof(name), "steady %i", id);
+    t->name_thread(name);
+  }
+
+  // random() takes a lock on every call; this thread gets a generator of its own
+  char state[256];
+  struct random_data generator;
+  memset(&generator, 0, sizeof(generator));
+  initstate_r(self->seeds[id], state, sizeof(state), &generator);
+  thread_random = &generator;
+
+  individual daddy, mommy, child;
+
+  while ( !self->stopping && !(self->limit && self->evaluations.load() >= self->limit) ) {
+
+    if ( self->pausing ) {
+      pthread_mutex_lock(&self->lock);
+      self->parked++;
+      pthread_cond_signal(&self->parking);
+      while ( self->pausing && !self->stopping )
+	pthread_cond_wait(&self->waking, &self->lock);
+      self->parked--;
+      pthread_mutex_unlock(&self->lock);
+      continue;
+    }
+
+    uint64_t span = trace_begin();
+    self->breed(&daddy, &mommy, &child);
+    trace_end("breeding", span);
+
+    // A child worse than everyone is worse than any loser replace() could draw
+    child.cutoff = self->worst.load(memory_order_relaxed);
+    evaluateFitness(&child);
+
+    span = trace_begin();
+    if ( !child.bounded && !child.isClone(&daddy) && !child.isClone(&mommy) )
+      self->replace(&child);
+    trace_end("replace", span);
+
+    // Whoever finishes a population's worth wakes main up
+    unsigned long done = self->evaluations.fetch_add(1) + 1;
+    if ( !(done % self->size) ) {
+      pthread_mutex_lock(&self->lock);
+      pthread_cond_broadcast(&self->epoch);
+      pthread_mutex_unlock(&self->lock);
+    }
+  }
+
+  // Out of work for good, which as far as pause() is concerned is parked
+  pthread_mutex_lock(&self->lock);
+  self->parked++;
+  pthread_cond_signal(&self->parking);
+  pthread_mutex_unlock(&self->lock);
+
+  thread_random = NULL;
+  return NULL;
+}
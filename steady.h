@@ -0,0 +1,93 @@
+#ifndef __STEADY_H
+#define __STEADY_H
+
+#include "global.h"
+#include "population.h"
+#include "individual.h"
+
+#include <pthread.h>
+#include <vector>
+#include <atomic>
+
+using namespace std;
+
+/*-- Evaluate in the calling thread, whatever the pool and workers are doing (fitness.cpp) --*/
+void evaluateFitness( void * );
+
+/*-- One individual of the population, as the steady state workers share it --*/
+typedef struct {
+  atomic<unsigned int> version;     // odd while a worker is replacing it
+  atomic<float> fitness;            // readable at any time, for the tournaments
+  atomic<float> mutation_rate;      // and for the average
+  individual *who;
+} steady_slot;
+
+/*
+ * Steady state evolution: STEADY_STATE = true in ga.rcp. NUM_THREADS
+ * workers (at least one) each loop on their own, with nothing to wait
+ * for but their own fitness evaluation:
+ *
+ *   pick two parents by tournament (TOURNAMENT_SIZE, default 2)
+ *   breed a child and evaluate it in the worker's own thread
+ *   pick a victim by a reverse tournament; if the child is fitter and
+ *   no one else got there first, it takes the victim's place
+ *
+ * Slots are claimed with a compare and swap on their version, which
+ * readers use as a seqlock, so parents are copied without any locks and
+ * a slot is only ever written by one worker. There is no generation
+ * barrier; main's "generation" is every population size evaluations,
+ * and advance() waits for the next one, and MAXIMUM_GENERATIONS is a
+ * budget of that many evaluations, after which the workers stop.
+ * Statistics come from the published fitness values, and mostfit is a
+ * private copy of the best individual, so main never reads a slot that's
+ * being written. Anything that walks the whole population (plots,
+ * checkpoints) must pause() the workers first, which waits for the
+ * children they're on.
+ */
+class steady_state {
+
+ public:
+  steady_state( population *, int );
+  ~steady_state( void );
+
+  void advance( void );
+  void pause( void );
+  void resume( void );
+  void stop( void );
+
+ protected:
+
+ private:
+  static void *worker( void * );
+  void breed( individual *, individual *, individual * );
+  int  tournament( bool );
+  void read( int, individual * );
+  bool replace( individual * );
+  void statistics( void );
+
+  population *society;
+  steady_slot *slots;
+  int size;
+  int tournament_size;
+
+  individual *champion;
+  atomic<float> worst;              // as of the last statistics(); slots only ever get fitter
+  unsigned int base_generation;
+  unsigned long limit;
+
+  vector<pthread_t> threads;
+  vector<unsigned int> seeds;
+  atomic<unsigned long> evaluations;
+  atomic<unsigned long> replacements;
+  atomic<bool> stopping;
+  atomic<bool> pausing;
+  int parked;
+  int started;
+
+  pthread_mutex_t lock;
+  pthread_cond_t epoch;
+  pthread_cond_t parking;
+  pthread_cond_t waking;
+};
+
+#endif
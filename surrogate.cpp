@@ -0,0 +1,238 @@
+#include "surrogate.h"
+#include "population.h"
+
+#include <errno.h>
+
+surrogate::surrogate( population *society ) {
+
+  this->n = params->NUMBER_OF_GENES;
+  this->k = params->has("SURROGATE_K") ? params->getInt("SURROGATE_K") : 5;
+  this->capacity = params->has("SURROGATE_ARCHIVE") ? params->getInt("SURROGATE_ARCHIVE") : 2000;
+  this->explore = params->has("SURROGATE_EXPLORE") ? params->getFloat("SURROGATE_EXPLORE") : 0.1f;
+
+  if ( this->k < 1 || this->capacity < this->k ) {
+    fprintf(stderr, "SURROGATE_K must be at least 1 and no more than SURROGATE_ARCHIVE\n");
+    exit(EINVAL);
+  }
+
+  this->points.resize((size_t)this->capacity*this->n);
+  this->values.resize(this->capacity);
+  this->query.resize(this->n);
+  this->nearest.resize(this->k);
+  this->neighbour.resize(this->k);
+  this->stored = this->oldest = 0;
+
+  this->screened = this->skipped = this->confirmed = 0;
+  this->promising = this->hits = 0;
+  this->explored = this->misses = 0;
+  this->predictions = 0;
+  this->error_sum = 0.0;
+
+  // Whoever's already been evaluated is where the model starts
+  for ( individual *person = society->first; person; person = person->next ) {
+    if ( person->bounded || person->estimated )
+      continue;
+    this->scale(person->gene, &this->query[0]);
+    this->remember(&this->query[0], person->fitness);
+  }
+
+  return;
+}
+
+surrogate::~surrogate( void ) {
+  return;
+}
+
+/*-- Genes to [0,1] by their limits --*/
+void surrogate::scale( const gene_t *gene, float *x ) {
+  for ( int i=0; i<this->n; i++ ) {
+    double range = params->pHI[i] - params->pLO[i];
+    x[i] = (range > 0.0) ? (float)((gene_value(gene[i]) - params->pLO[i])/range) : 0.0f;
+  }
+  return;
+}
+
+/*-- Into the archive, over the oldest once it's full --*/
+void surrogate::remember( const float *x, float fitness ) {
+  memcpy(&this->points[(size_t)this->oldest*this->n], x, this->n*sizeof(float));
+  this->values[this->oldest] = fitness;
+  this->oldest = (this->oldest + 1) % this->capacity;
+  if ( this->stored < this->capacity )
+    this->stored++;
+  return;
+}
+
+/*-- Inverse square distance weighted mean of the k nearest, or the exact value if it's been seen --*/
+float surrogate::predict( const float *x ) {
+
+  const int n = this->n;
+  int found = 0;
+
+  for ( int j=0; j<this->stored; j++ ) {
+    const float *p = &this->points[(size_t)j*n];
+    float d = 0.0f;
+    for ( int i=0; i<n; i++ )
+      d += (p[i] - x[i])*(p[i] - x[i]);
+
+    if ( found == this->k && d >= this->nearest[found-1] )
+      continue;
+
+    // Insertion into the k best so far
+    int slot = (found < this->k) ? found++ : found - 1;
+    while ( slot > 0 && this->nearest[slot-1] > d ) {
+      this->nearest[slot] = this->nearest[slot-1];
+      this->neighbour[slot] = this->neighbour[slot-1];
+      slot--;
+    }
+    this->nearest[slot] = d;
+    this->neighbour[slot] = j;
+  }
+
+  if ( this->nearest[0] <= 0.0f )
+    return this->values[this->neighbour[0]];
+
+  double sum = 0.0, weights = 0.0;
+  for ( int i=0; i<found; i++ ) {
+    double w = 1.0/this->nearest[i];
+    sum += w*this->values[this->neighbour[i]];
+    weights += w;
+  }
+  return (float)(sum/weights);
+}
+
+/*
+ * True if baby should be evaluated, and it's on the pending list. If not,
+ * its fitness is the prediction, flagged as estimated, until confirm()
+ * finds it among the places that matter.
+ */
+bool surrogate::screen( individual *baby, individual *daddy, individual *mommy ) {
+
+  individual *fitter = (daddy->fitness <= mommy->fitness) ? daddy : mommy;
+  child c;
+  c.who = baby;
+  c.threshold = fitter->fitness;
+  this->screened++;
+
+  // Too little to go on yet
+  if ( this->stored < this->k ) {
+    c.predicted = NAN;
+    c.promising = true;
+    this->pending.push_back(c);
+    return true;
+  }
+
+  this->scale(baby->gene, &this->query[0]);
+  c.predicted = this->predict(&this->query[0]);
+  c.promising = c.predicted < c.threshold;
+
+  if ( c.promising || randf() < this->explore ) {
+    this->pending.push_back(c);
+    return true;
+  }
+
+  baby->fitness = c.predicted;
+  baby->estimated = true;
+  this->skipped++;
+  return false;
+}
+
+/*-- Once the pending children have their fitness: score the predictions and add them to the archive --*/
+void surrogate::learn( void ) {
+
+  for ( unsigned int i=0; i<this->pending.size(); i++ ) {
+    child &c = this->pending[i];
+    float actual = c.who->fitness;
+
+    if ( !isnan(c.predicted) ) {
+      // A bounded fitness is only a lower bound, no good for measuring error
+      if ( !c.who->bounded ) {
+	this->predictions++;
+	this->error_sum += fabs(c.predicted - actual);
+      }
+      if ( c.promising ) {
+	this->promising++;
+	this->hits += (actual < c.threshold);
+      } else {
+	this->explored++;
+	this->misses += (actual < c.threshold);
+      }
+    }
+
+    // Nor for predicting from
+    if ( !c.who->bounded ) {
+      this->scale(c.who->gene, &this->query[0]);
+      this->remember(&this->query[0], actual);
+    }
+  }
+  this->pending.clear();
+
+  return;
+}
+
+/*
+ * The parents of the old generation aren't in the new one, so a child
+ * with only a prediction can sort first. Whoever is estimated among the
+ * most fit and the elites copy_elites() will keep is evaluated for real
+ * and the generation sorted again, as many times as it takes.
+ */
+void surrogate::confirm( population *society ) {
+
+  int places = params->PERCENT_ELITES_KEPT ?
+    (int)fround(params->PERCENT_ELITES_KEPT*society->last->count, 0) : 1;
+  if ( places < 1 )
+    places = 1;
+
+  vector<individual *> estimated;
+  for (;;) {
+    estimated.clear();
+    individual *person = society->first;
+    for ( int i=0; person && i<places; i++, person = person->next )
+      if ( person->estimated )
+	estimated.push_back(person);
+    if ( estimated.empty() )
+      break;
+
+    if ( params->ASYNC_FITNESS )
+      lock();
+    for ( unsigned int i=0; i<estimated.size(); i++ )
+      getFitness((void *)estimated[i]);
+    if ( params->ASYNC_FITNESS ) {
+      unlock();
+      wait_for_threads();
+    }
+
+    for ( unsigned int i=0; i<estimated.size(); i++ ) {
+      if ( !estimated[i]->bounded ) {
+	this->scale(estimated[i]->gene, &this->query[0]);
+	this->remember(&this->query[0], estimated[i]->fitness);
+      }
+    }
+    this->confirmed += estimated.size();
+
+    society->sort();
+  }
+
+  return;
+}
+
+float surrogate::hit_rate( void ) {
+  return this->promising ? (float)this->hits/this->promising : 0.0f;
+}
+
+float surrogate::false_rejections( void ) {
+  return this->explored ? (float)this->misses/this->explored : 0.0f;
+}
+
+float surrogate::error( void ) {
+  return this->predictions ? (float)(this->error_sum/this->predictions) : 0.0f;
+}
+
+void surrogate::report( void ) {
+  log_printf("Surrogate: %lu children, %lu evaluated (%lu to confirm a place), %lu skipped; "
+	     "hit rate %.1f%%, false rejections %.1f%%, mean error %.*f\n",
+	     this->screened, this->screened - this->skipped + this->confirmed, this->confirmed,
+	     this->skipped - this->confirmed,
+	     100.0f*this->hit_rate(), 100.0f*this->false_rejections(),
+	     params->ACCURACY, this->error());
+  return;
+}
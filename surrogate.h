@@ -0,0 +1,90 @@
+#ifndef __SURROGATE_H
+#define __SURROGATE_H
+
+#include "global.h"
+#include "individual.h"
+
+#include <vector>
+
+using namespace std;
+
+class population;
+
+/*
+ * Surrogate pre-screening for mate(): SURROGATE = true in ga.rcp, with
+ *
+ *   int   SURROGATE_K = 5              neighbours a prediction is made from
+ *   int   SURROGATE_ARCHIVE = 2000     evaluated genomes kept, oldest go first
+ *   float SURROGATE_EXPLORE = 0.1      fraction of rejects evaluated anyway
+ *
+ * A k nearest neighbour regressor, inverse square distance weighted, over
+ * genomes that have already been evaluated, in coordinates scaled to
+ * [0,1] by the gene limits. Each child is predicted as it's bred; one
+ * predicted to beat its fitter parent goes on to the fitness library,
+ * and one that isn't keeps the prediction as its fitness, flagged as
+ * estimated, and costs nothing, unless it's drawn for exploration. Every
+ * child evaluated is added to the archive once its generation's batch is
+ * in, and is how the hit rate (predicted better, was better), the false
+ * rejection rate (explored, predicted worse but wasn't) and the
+ * prediction error are kept.
+ *
+ * A prediction never decides who is most fit or who is kept as an elite:
+ * once the new generation is sorted, confirm() evaluates any estimated
+ * individual in those places and sorts again, until none is left there.
+ */
+class surrogate {
+
+ public:
+  surrogate( population * );
+  ~surrogate( void );
+
+  bool screen( individual *, individual *, individual * );
+  void learn( void );
+  void confirm( population * );
+  void report( void );
+
+  float hit_rate( void );
+  float false_rejections( void );
+  float error( void );
+
+  struct child {
+    individual *who;
+    float predicted;
+    float threshold;
+    bool promising;
+  };
+  vector<child> pending;            // to be evaluated this generation
+
+  unsigned long screened;
+  unsigned long skipped;
+  unsigned long confirmed;          // skipped, then evaluated after all for sorting to the top
+
+ protected:
+
+ private:
+  void scale( const gene_t *, float * );
+  float predict( const float * );
+  void remember( const float *, float );
+
+  int n;
+  int k;
+  int capacity;
+  int stored;
+  int oldest;
+  float explore;
+
+  vector<float> points;             // capacity x n, scaled genes
+  vector<float> values;             // their fitness
+  vector<float> query;
+  vector<float> nearest;            // k best squared distances, ascending
+  vector<int> neighbour;
+
+  unsigned long promising;
+  unsigned long hits;
+  unsigned long explored;
+  unsigned long misses;
+  unsigned long predictions;
+  double error_sum;
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include <threadpool.h>
+#include "trace.h"
 
 void threadpool::start(void) {
   for ( unsigned i=0; i<this->poolSize; i++ )
@@ -47,7 +48,7 @@ threadpool::threadpool( void fptr(void *), unsigned n, bool vb ) {
   tid = new pthread_t[n];
 
   queue_not_empty = queue_is_empty = PTHREAD_COND_INITIALIZER;
-  print_lock = write_lock = read_lock = PTHREAD_MUTEX_INITIALIZER;
+  print_lock = write_lock = read_lock = wait_lock = PTHREAD_MUTEX_INITIALIZER;
 
   queue_empty = true;
   verbose = vb;
@@ -120,6 +121,7 @@ void threadpool::enqueue( void *p ) {
 void *threadpool::dequeue(pthread_t id) {
   void *p = NULL;
   void *last = NULL;
+  uint64_t start = trace_begin();
 
   if ( this->shutting_down ) {
     if ( this->verbose ) cout << id << " returning null on shutdown\n";
@@ -131,7 +133,9 @@ void *threadpool::dequeue(pthread_t id) {
 
   if ( this->queue_empty ) {
     if (this->verbose ) cout << "\n" << id << ": Waiting for queue fill\n";
+    uint64_t idle = trace_begin();
     pthread_cond_wait(&this->queue_not_empty, &read_lock);
+    trace_end("idle", idle);
   }
 
   if (this->verbose ) cout << "\n" << id << ": Got lock... dequeuing\n";
@@ -166,6 +170,7 @@ void *threadpool::dequeue(pthread_t id) {
 
   if (this->verbose ) cout << "\n" << id << ": Done.\n";
 
+  trace_end("dequeue", start);
   return p;
 
 }
@@ -0,0 +1,184 @@
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+atomic<tracer *> trace(NULL);
+
+static __thread trace_buffer *mine = NULL;
+
+trace_buffer::trace_buffer( int tid, const char *name ) {
+  this->tid = tid;
+  strncpy(this->name, name, sizeof(this->name)-1);
+  this->name[sizeof(this->name)-1] = '\0';
+  this->renamed = true;
+  this->dropped = 0;
+  this->head = 0;
+  this->tail = 0;
+  return;
+}
+
+/*-- Producer side, only ever called by the thread that owns the buffer --*/
+void trace_buffer::push( const char *name, uint64_t start, uint64_t end, int64_t arg ) {
+
+  uint32_t h = this->head.load(memory_order_relaxed);
+  if ( h - this->tail.load(memory_order_acquire) >= TRACE_RING ) {
+    this->dropped.fetch_add(1, memory_order_relaxed);
+    return;
+  }
+
+  trace_event *e = &this->ring[h & (TRACE_RING-1)];
+  e->name = name;
+  e->start = start;
+  e->duration = end - start;
+  e->arg = arg;
+
+  this->head.store(h+1, memory_order_release);
+  return;
+}
+
+/*-- Consumer side, only ever called by the flusher --*/
+unsigned int trace_buffer::drain( FILE *f, uint64_t origin ) {
+
+  uint32_t t = this->tail.load(memory_order_relaxed);
+  uint32_t h = this->head.load(memory_order_acquire);
+
+  for ( uint32_t i=t; i!=h; i++ ) {
+    trace_event *e = &this->ring[i & (TRACE_RING-1)];
+    fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%i,\"ts\":%.3f,\"dur\":%.3f",
+	    e->name, this->tid, (e->start - origin)/1000.0, e->duration/1000.0);
+    if ( e->arg >= 0 )
+      fprintf(f, ",\"args\":{\"n\":%li}", (long)e->arg);
+    fputc('}', f);
+  }
+
+  this->tail.store(h, memory_order_release);
+  return h - t;
+}
+
+tracer::tracer( const char *file ) {
+
+  errno = 0;
+  if ( !(this->out = fopen(file, "w")) ) {
+    perror(file);
+    exit(errno);
+  }
+
+  this->origin = trace_now();
+  this->stopping = false;
+  this->closed = false;
+  pthread_mutex_init(&this->threads_lock, NULL);
+
+  // Every event after this one starts with a comma
+  fprintf(this->out, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"ga\"}}");
+
+  if ( pthread_create(&this->thread, NULL, tracer::flusher, this) ) {
+    perror("trace flusher");
+    exit(errno);
+  }
+
+  return;
+}
+
+tracer::~tracer( void ) {
+
+  this->close();
+
+  for ( unsigned int i=0; i<this->threads.size(); i++ )
+    delete this->threads[i];
+
+  pthread_mutex_destroy(&this->threads_lock);
+  return;
+}
+
+/*-- Last flush and the closing bracket; events recorded after this are kept, not written --*/
+void tracer::close( void ) {
+
+  if ( this->closed )
+    return;
+  this->closed = true;
+
+  this->stopping = true;
+  pthread_join(this->thread, NULL);
+  this->flush();
+
+  fprintf(this->out, "\n]\n");
+  fclose(this->out);
+
+  unsigned long dropped = 0;
+  pthread_mutex_lock(&this->threads_lock);
+  for ( unsigned int i=0; i<this->threads.size(); i++ )
+    dropped += this->threads[i]->dropped;
+  pthread_mutex_unlock(&this->threads_lock);
+  if ( dropped )
+    fprintf(stderr, "Trace dropped %lu events, raise TRACE_RING\n", dropped);
+
+  return;
+}
+
+/*-- This thread's buffer, registered the first time it records anything --*/
+trace_buffer *tracer::local( void ) {
+
+  if ( mine )
+    return mine;
+
+  pthread_mutex_lock(&this->threads_lock);
+  char name[32];
+  int tid = this->threads.size() + 1;
+  snprintf(name, sizeof(name), "thread %i", tid);
+  mine = new trace_buffer( tid, name );
+  this->threads.push_back(mine);
+  pthread_mutex_unlock(&this->threads_lock);
+
+  return mine;
+}
+
+/*-- Label the calling thread's track; picked up at the next flush --*/
+void tracer::name_thread( const char *name ) {
+  trace_buffer *b = this->local();
+  pthread_mutex_lock(&this->threads_lock);
+  strncpy(b->name, name, sizeof(b->name)-1);
+  b->renamed = true;
+  pthread_mutex_unlock(&this->threads_lock);
+  return;
+}
+
+void tracer::span( const char *name, uint64_t start, uint64_t end, int64_t arg ) {
+  this->local()->push(name, start, end, arg);
+  return;
+}
+
+void tracer::flush( void ) {
+
+  pthread_mutex_lock(&this->threads_lock);
+  vector<trace_buffer *> list = this->threads;
+
+  for ( unsigned int i=0; i<list.size(); i++ ) {
+    if ( !list[i]->renamed )
+      continue;
+    fprintf(this->out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"%s\"}}",
+	    list[i]->tid, list[i]->name);
+    list[i]->renamed = false;
+  }
+  pthread_mutex_unlock(&this->threads_lock);
+
+  unsigned int events = 0;
+  for ( unsigned int i=0; i<list.size(); i++ )
+    events += list[i]->drain(this->out, this->origin);
+
+  if ( events )
+    fflush(this->out);
+  return;
+}
+
+void *tracer::flusher( void *arg ) {
+  tracer *t = (tracer *)arg;
+
+  while ( !t->stopping ) {
+    usleep(TRACE_FLUSH_MS*1000);
+    t->flush();
+  }
+  return NULL;
+}
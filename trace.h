@@ -0,0 +1,121 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <atomic>
+#include <vector>
+
+using namespace std;
+
+/*
+ * Timeline tracing in Chrome's trace event format, for chrome://tracing or
+ * ui.perfetto.dev. With TRACE_FILE set in ga.rcp every thread records
+ * complete ("X") events into a ring buffer of its own: the producer is the
+ * only writer of head and the flusher the only writer of tail, so
+ * recording an event takes no lock. A background thread drains the rings
+ * into the file every TRACE_FLUSH_MS. If a ring fills up before it's
+ * drained, events are dropped and counted rather than blocking.
+ *
+ * Event names must be string literals (or otherwise outlive the tracer),
+ * only the pointer is kept.
+ *
+ * trace is loaded once per call, since pool threads that are never
+ * stopped may be recording while main shuts tracing down. That's why
+ * close() writes the file out and leaves the tracer allocated: a thread
+ * that loaded the pointer just before it was cleared still has somewhere
+ * to put its event.
+ */
+#define TRACE_RING      16384          // events per thread, a power of two
+#define TRACE_FLUSH_MS  100
+
+typedef struct {
+  const char *name;
+  uint64_t start;                      // ns, monotonic clock
+  uint64_t duration;
+  int64_t arg;                         // shown as args.n, unless < 0
+} trace_event;
+
+class trace_buffer {
+
+ public:
+  trace_buffer( int, const char * );
+
+  void push( const char *, uint64_t, uint64_t, int64_t );
+  unsigned int drain( FILE *, uint64_t );
+
+  int tid;
+  char name[32];
+  bool renamed;                        // name not written out yet
+  atomic<unsigned long> dropped;
+
+ protected:
+
+ private:
+  trace_event ring[TRACE_RING];
+  atomic<uint32_t> head;
+  atomic<uint32_t> tail;
+};
+
+class tracer {
+
+ public:
+  tracer( const char * );
+  ~tracer( void );
+
+  void name_thread( const char * );
+  void span( const char *, uint64_t, uint64_t, int64_t = -1 );
+  void close( void );
+
+ protected:
+
+ private:
+  trace_buffer *local( void );
+  void flush( void );
+  static void *flusher( void * );
+
+  FILE *out;
+  uint64_t origin;
+  pthread_t thread;
+  atomic<bool> stopping;
+  bool closed;
+
+  pthread_mutex_t threads_lock;
+  vector<trace_buffer *> threads;
+};
+
+extern atomic<tracer *> trace;
+
+inline uint64_t trace_now( void ) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000ull + ts.tv_nsec;
+}
+
+/*-- Start a span: the time, or 0 if tracing is off --*/
+inline uint64_t trace_begin( void ) {
+  return trace.load(memory_order_acquire) ? trace_now() : 0;
+}
+
+/*-- Record a span from since until now --*/
+inline void trace_end( const char *name, uint64_t since, int64_t arg = -1 ) {
+  tracer *t = trace.load(memory_order_acquire);
+  if ( t )
+    t->span(name, since, trace_now(), arg);
+  return;
+}
+
+/*-- Record a span and start the next one where it stopped --*/
+inline uint64_t trace_mark( const char *name, uint64_t since ) {
+  tracer *t = trace.load(memory_order_acquire);
+  if ( !t )
+    return 0;
+  uint64_t now = trace_now();
+  t->span(name, since, now);
+  return now;
+}
+
+#endif
@@ -4,16 +4,45 @@
 #include <stdlib.h>
 #include <math.h>
 
-static int UTILITY_ACCURACY;
+__thread struct random_data *thread_random = NULL;
+
+double gene_quantum = 1.0;
+double gene_steps   = 1.0;
+
+/*
+ * Work out the fixed point step from ACCURACY, and pull the gene limits in
+ * onto the nearest steps so every in-bounds value is representable. Does
+ * nothing much for floating point genes.
+ */
+void gene_setup( void ) {
+
+  gene_steps   = pow(10.0, params->ACCURACY);
+  gene_quantum = 1.0/gene_steps;
+
+#ifdef GENE_FIXED
+  double largest = numeric_limits<gene_t>::max()*gene_quantum;
+
+  for ( int i=0; i<params->NUMBER_OF_GENES; i++ ) {
+    if ( fabs(params->pLO[i]) > largest || fabs(params->pHI[i]) > largest ) {
+      fprintf(stderr, "Gene %i limits [%g, %g] don't fit %i byte fixed point genes at ACCURACY %i\n",
+	      i, params->pLO[i], params->pHI[i], (int)sizeof(gene_t), params->ACCURACY);
+      exit(EINVAL);
+    }
+    params->pLO[i] = ceil(params->pLO[i]*gene_steps)*gene_quantum;
+    params->pHI[i] = floor(params->pHI[i]*gene_steps)*gene_quantum;
+  }
+#endif
+
+  return;
+}
 
 /*-- Simple, locally available, function to round a floating point number --*/
 double fround( double number, int digits ) {
+  static param_handle ACCURACY = params->handle("ACCURACY", PARAM_INT);
   double rounded_number =  0.0f;
 
-  if ( !UTILITY_ACCURACY )
-    UTILITY_ACCURACY = params->getInt("ACCURACY");
-
-  char   rounded_number_string[UTILITY_ACCURACY];
+  // room for the sign, the integer part and the point as well as the digits
+  char   rounded_number_string[params->getInt(ACCURACY) + digits + 48];
   char   format[8];
   
   sprintf( format, "%%.%if", digits );
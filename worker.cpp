@@ -0,0 +1,204 @@
+/*
+ * ga_worker: evaluates fitness batches on behalf of a ga process.
+ *
+ *   ga_worker [parameter file] <unix:/path | host:port>
+ *
+ * The worker reads the same parameter file as the coordinator so the
+ * fitness library is set up identically, then listens for a coordinator
+ * and answers its BATCH frames with RESULT frames. NUM_THREADS in the
+ * parameter file sets how many local threads each batch is spread over.
+ */
+#include "global.h"
+#include "individual.h"
+#include "remote.h"
+#include <fitness.h>
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+
+/*-- Global statements --*/
+char state[512];
+parameters *params;
+
+/*-- Batches received but not yet evaluated, filled by the reader, drained by the evaluator --*/
+typedef struct {
+  uint32_t id;
+  uint32_t count;
+  vector<char> genes;
+} job;
+
+static deque<job> jobs;
+static pthread_mutex_t job_lock  = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t send_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  job_ready = PTHREAD_COND_INITIALIZER;
+static bool hangup = false;
+static int  coordinator = -1;
+
+static bool reply( uint16_t type, uint32_t batch, uint32_t count, const void *p = NULL, size_t n = 0 ) {
+  pthread_mutex_lock(&send_lock);
+  bool ok = remote_send(coordinator, type, batch, count, p, n);
+  pthread_mutex_unlock(&send_lock);
+  return ok;
+}
+
+/*-- Evaluate batches in arrival order while the reader keeps answering heartbeats --*/
+static void *evaluator( void * ) {
+
+  vector<individual *> scratch;
+  vector<float> fitness;
+  int nGenes = params->NUMBER_OF_GENES;
+
+  for (;;) {
+    pthread_mutex_lock(&job_lock);
+    while ( jobs.empty() && !hangup )
+      pthread_cond_wait(&job_ready, &job_lock);
+    if ( jobs.empty() ) {
+      pthread_mutex_unlock(&job_lock);
+      break;
+    }
+    job j;
+    j.id = jobs.front().id;
+    j.count = jobs.front().count;
+    j.genes.swap(jobs.front().genes);
+    jobs.pop_front();
+    pthread_mutex_unlock(&job_lock);
+
+    while ( scratch.size() < j.count )
+      scratch.push_back(new individual());
+    fitness.resize(j.count);
+
+    const gene_t *genes = (const gene_t *)j.genes.data();
+    for ( unsigned int i=0; i<j.count; i++ )
+      memcpy(scratch[i]->gene, &genes[i*nGenes], nGenes*sizeof(gene_t));
+
+    if ( params->ASYNC_FITNESS ) {
+      lock();
+      for ( unsigned int i=0; i<j.count; i++ )
+	getFitness((void *)scratch[i]);
+      unlock();
+      wait_for_threads();
+    } else {
+      for ( unsigned int i=0; i<j.count; i++ )
+	getFitness((void *)scratch[i]);
+    }
+
+    for ( unsigned int i=0; i<j.count; i++ )
+      fitness[i] = scratch[i]->fitness;
+
+    if ( !reply(FRAME_RESULT, j.id, j.count, fitness.data(), j.count*sizeof(float)) )
+      break;
+  }
+
+  for ( unsigned int i=0; i<scratch.size(); i++ )
+    delete scratch[i];
+
+  return NULL;
+}
+
+/*-- Serve one coordinator until it says goodbye or goes away --*/
+static void serve( void ) {
+
+  frame_header hdr;
+  vector<char> payload;
+
+  if ( !remote_recv(coordinator, &hdr, payload) || hdr.type != FRAME_HELLO )
+    return;
+
+  if ( (int)hdr.count != params->NUMBER_OF_GENES || hdr.batch != GENE_FORMAT ) {
+    fprintf(stderr, "ga_worker: coordinator wants %i genes of format %#x, configured for %i of %#x\n",
+	    hdr.count, hdr.batch, params->NUMBER_OF_GENES, GENE_FORMAT);
+    reply(FRAME_BYE, 0, 0);
+    return;
+  }
+  reply(FRAME_HELLO, GENE_FORMAT, params->NUMBER_OF_GENES);
+
+  hangup = false;
+  pthread_t tid;
+  pthread_create(&tid, NULL, evaluator, NULL);
+
+  while ( remote_recv(coordinator, &hdr, payload) ) {
+
+    if ( hdr.type == FRAME_BYE )
+      break;
+
+    if ( hdr.type == FRAME_PING ) {
+      reply(FRAME_PONG, hdr.batch, 0);
+
+    } else if ( hdr.type == FRAME_BATCH ) {
+      pthread_mutex_lock(&job_lock);
+      jobs.push_back(job());
+      jobs.back().id = hdr.batch;
+      jobs.back().count = hdr.count;
+      jobs.back().genes.swap(payload);
+      pthread_mutex_unlock(&job_lock);
+      pthread_cond_signal(&job_ready);
+    }
+  }
+
+  /*-- Unblock the evaluator, drop anything it hasn't started and wait for it --*/
+  pthread_mutex_lock(&job_lock);
+  hangup = true;
+  jobs.clear();
+  pthread_mutex_unlock(&job_lock);
+  pthread_cond_signal(&job_ready);
+  shutdown(coordinator, SHUT_RDWR);
+  pthread_join(tid, NULL);
+
+  return;
+}
+
+int main( int argc, char** argv ) {
+
+  if ( argc < 2 ) {
+    fprintf(stderr, "usage: %s [parameter file] <unix:/path | host:port>\n", argv[0]);
+    exit(EINVAL);
+  }
+
+  const char *rcfile  = (argc > 2) ? argv[1] : "ga.rcp";
+  const char *address = argv[argc-1];
+
+  params = new parameters( (char *)rcfile );
+
+  // A worker always evaluates locally, never forwards to other workers
+  params->WORKERS = NULL;
+  params->ASYNC_FITNESS = params->NUM_THREADS;
+
+  gene_setup();
+
+  initstate( params->SEED, (char *)state, 256);
+  srandom(params->SEED);
+
+  initialize_fitness_library();
+
+  int listener = remote_listen(address);
+  if ( listener < 0 ) {
+    perror(address);
+    exit(errno);
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  if ( params->VERBOSE )
+    fprintf(stderr, "ga_worker: listening on %s\n", address);
+
+  for (;;) {
+    if ( (coordinator = accept(listener, NULL, NULL)) < 0 ) {
+      if ( errno == EINTR )
+	continue;
+      perror("accept");
+      exit(errno);
+    }
+
+    if ( params->VERBOSE )
+      fprintf(stderr, "ga_worker: coordinator connected\n");
+
+    serve();
+    close(coordinator);
+
+    if ( params->VERBOSE )
+      fprintf(stderr, "ga_worker: coordinator disconnected\n");
+  }
+
+  delete params;
+  return 0;
+}